@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+static struct arena_chunk *arena_add_chunk(struct arena *arena, size_t min_size)
+// Allocates a new chunk of at least min_size bytes and pushes it onto the
+// front of the chunk list. Returns NULL if out of memory.
+{
+	size_t size = ARENA_CHUNK_SIZE;
+	if (min_size > size) {
+		size = min_size;
+	}
+	struct arena_chunk *chunk = malloc(sizeof(*chunk) + size);
+	if (!chunk) {
+		return (NULL);
+	}
+	chunk->used = 0;
+	chunk->size = size;
+	chunk->next = arena->head;
+	arena->head = chunk;
+	arena->total_bytes += sizeof(*chunk) + size;
+	return (chunk);
+}
+
+struct arena *arena_create(void)
+// Returns a pointer to a new, empty arena, or NULL if out of memory.
+// No chunks are allocated until the first string is stored.
+{
+	struct arena *arena = malloc(sizeof(*arena));
+	if (!arena) {
+		return (NULL);
+	}
+	arena->head = NULL;
+	arena->total_bytes = 0;
+	arena->used_bytes = 0;
+	return (arena);
+}
+
+char *arena_alloc(struct arena *arena, size_t len)
+// Reserves len contiguous, unaligned bytes in the arena and returns a
+// pointer to them, or NULL if out of memory. They live until
+// arena_destroy() is called.
+{
+	struct arena_chunk *chunk = arena->head;
+	if (!chunk || chunk->size - chunk->used < len) {
+		// Case: Current chunk is full, start a new one
+		chunk = arena_add_chunk(arena, len);
+		if (!chunk) {
+			return (NULL);
+		}
+	}
+	char *stored = chunk->data + chunk->used;
+	chunk->used += len;
+	arena->used_bytes += len;
+	return (stored);
+}
+
+char *arena_store(struct arena *arena, const char *str, size_t len)
+// Copies len bytes of str into the arena and returns a pointer to the
+// copy, or NULL if out of memory. No terminating NUL is added. The
+// copy lives until arena_destroy() is called.
+{
+	char *stored = arena_alloc(arena, len);
+	if (stored) {
+		memcpy(stored, str, len);
+	}
+	return (stored);
+}
+
+void arena_destroy(struct arena *arena)
+// Releases every chunk owned by the arena, along with the arena itself.
+{
+	if (!arena) {
+		return;
+	}
+	struct arena_chunk *chunk = arena->head;
+	while (chunk) {
+		struct arena_chunk *next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	free(arena);
+}
+
+void arena_reset(struct arena *arena)
+// Forgets every string stored in the arena so its space can be reused,
+// keeping only the most recent chunk allocated.
+{
+	if (!arena->head) {
+		return;
+	}
+	struct arena_chunk *chunk = arena->head->next;
+	while (chunk) {
+		struct arena_chunk *next = chunk->next;
+		arena->total_bytes -= sizeof(*chunk) + chunk->size;
+		free(chunk);
+		chunk = next;
+	}
+	arena->head->next = NULL;
+	arena->head->used = 0;
+	arena->used_bytes = 0;
+}
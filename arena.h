@@ -0,0 +1,34 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+enum arena_sizes {
+	ARENA_CHUNK_SIZE = 1 << 20	// Default size of each arena chunk in
+	// bytes; larger requests get a chunk of their own
+};
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t used;
+	size_t size;
+	char data[];
+};
+
+struct arena {
+	struct arena_chunk *head;	// Chunk currently being filled
+	size_t total_bytes;	// Bytes currently held from the system
+	size_t used_bytes;	// Bytes handed out since the last reset
+};
+
+struct arena *arena_create(void);
+
+char *arena_alloc(struct arena *arena, size_t len);
+
+char *arena_store(struct arena *arena, const char *str, size_t len);
+
+void arena_reset(struct arena *arena);
+
+void arena_destroy(struct arena *arena);
+
+#endif
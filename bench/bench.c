@@ -0,0 +1,324 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "arena.h"
+#include "hash.h"
+#include "output.h"
+#include "sort.h"
+#include "tokenize.h"
+#include "utf8.h"
+
+// Times each phase ws is built from on every corpus file given and
+// prints one tab-separated line per phase: the label, corpus, word and
+// byte counts, phase, thread count and the fastest of the repeated runs
+// in seconds. The phases call the same functions as ws itself.
+
+enum bench_sizes {
+	DEFAULT_REPEATS = 3,
+	WINDOW = 10		// Words kept by the -c and -C phases
+};
+
+struct bench_words {
+	struct word *words;
+	size_t len;
+	size_t max;
+};
+
+enum bench_phase {
+	PHASE_LOAD,
+	PHASE_SORT,
+	PHASE_UNIQUE,
+	PHASE_TOP,
+	PHASE_BOTTOM,
+	PHASE_SCRABBLE,
+	PHASE_OUTPUT
+};
+
+struct bench_state {
+	const char *buf;	// Mapped corpus
+	size_t bytes;
+	struct bench_words loaded;	// Words in corpus order
+	struct bench_words counted;	// loaded interned as by --count
+	const struct bench_words *input;	// What the phases after
+	// loading work on, loaded or counted
+	struct word *sorted;	// loaded, sorted by algorithm
+	struct word *work;	// Scratch copy for phases that prune
+	int (*algorithm)(const void *, const void *);
+	bool case_insensitive;
+	size_t threads;
+	struct output *out;
+};
+
+static const struct {
+	const char *name;
+	int (*algorithm)(const void *, const void *);
+	bool case_insensitive;
+	bool counted;		// Sorts the words interned by --count
+	bool utf8;		// Needs UTF-8 mode, which cannot be left
+	// again, so these sorts come last
+} sorts[] = {
+	{ "ascii", ascii_sort, false, false, false },
+	{ "insensitive", insensitive_ascii_sort, true, false, false },
+	{ "length", len_sort, false, false, false },
+	{ "numeric", num_sort, false, false, false },
+	{ "bignum", big_num_sort, false, false, false },
+	{ "scrabble", scrabble_sort, false, false, false },
+	{ "frequency", count_sort, false, true, false },
+	{ "collate", collate_sort, false, false, true },
+	{ "insensitive_collate", insensitive_collate_sort, true, false, true },
+};
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static void emit_bench(void *ctx, const char *word, size_t len)
+// tokenize() callback collecting views, as ws does for mapped files.
+{
+	struct bench_words *words = ctx;
+	if (words->len == words->max) {
+		words->max = words->max ? 2 * words->max : 1024;
+		words->words = realloc(words->words,
+				       words->max * sizeof(*words->words));
+		if (!words->words) {
+			fprintf(stderr, "Memory allocation error.\n");
+			exit(3);
+		}
+	}
+	words->words[words->len].str = word;
+	words->words[words->len].len = len;
+	++words->len;
+}
+
+static void intern_words(struct bench_state *state, struct arena *arena)
+// Interns the loaded words into state->counted as count_word() does
+// for --count: each distinct word once, in order of first appearance,
+// copied into arena after its number of occurrences.
+{
+	struct word_set seen;
+	word_set_init(&seen, false);
+	for (size_t i = 0; i < state->loaded.len; ++i) {
+		const struct word *word = &state->loaded.words[i];
+		bool added;
+		struct word *interned = word_set_insert(&seen, word, &added);
+		char *stored = NULL;
+		size_t count = 1;
+		if (interned && added) {
+			stored = arena_alloc(arena, sizeof(count) + word->len);
+		}
+		if (!interned || (added && !stored)) {
+			fprintf(stderr, "Memory allocation error.\n");
+			exit(3);
+		}
+		if (!added) {
+			count = word_count(interned) + 1;
+			memcpy((char *)interned->str - sizeof(count), &count,
+			       sizeof(count));
+			continue;
+		}
+		memcpy(stored, &count, sizeof(count));
+		memcpy(stored + sizeof(count), word->str, word->len);
+		interned->str = stored + sizeof(count);
+		emit_bench(&state->counted, interned->str, word->len);
+	}
+	word_set_free(&seen);
+}
+
+static double time_phase(struct bench_state *state, enum bench_phase phase,
+			 int repeats)
+// Runs phase repeats times on a fresh copy of its input and returns the
+// fastest run in seconds. Only the phase itself is timed.
+{
+	const struct bench_words *input = state->input;
+	size_t size = input->len * sizeof(*input->words);
+	size_t window = WINDOW < input->len ? WINDOW : input->len;
+	double best = 0;
+	for (int run = 0; run < repeats; ++run) {
+		size_t len = input->len;
+		switch (phase) {
+		case PHASE_LOAD:
+			state->loaded.len = 0;
+			break;
+		case PHASE_SORT:
+			memcpy(state->sorted, input->words, size);
+			break;
+		case PHASE_UNIQUE:
+			memcpy(state->work, state->sorted, size);
+			break;
+		default:
+			memcpy(state->work, input->words, size);
+			break;
+		}
+		double start = now();
+		switch (phase) {
+		case PHASE_LOAD:
+			tokenize(state->buf, state->bytes, true, emit_bench,
+				 &state->loaded);
+			break;
+		case PHASE_SORT:
+			sort_words(state->sorted, len, state->algorithm,
+				   state->threads);
+			break;
+		case PHASE_UNIQUE:
+			filter_words(state->work, &len, false, true,
+				     state->algorithm, state->case_insensitive);
+			break;
+		case PHASE_TOP:
+			select_words(state->work, len, 0, window,
+				     state->algorithm);
+			break;
+		case PHASE_BOTTOM:
+			select_words(state->work, len, len - window, len,
+				     state->algorithm);
+			break;
+		case PHASE_SCRABBLE:
+			filter_words(state->work, &len, true, false,
+				     state->algorithm, state->case_insensitive);
+			break;
+		case PHASE_OUTPUT:
+			output_words(state->out, state->sorted, len, false, false);
+			output_flush(state->out);
+			break;
+		}
+		double elapsed = now() - start;
+		best = run && best < elapsed ? best : elapsed;
+	}
+	return (best);
+}
+
+static void report(const char *label, const char *corpus,
+		   const struct bench_state *state, const char *phase,
+		   const char *variant, size_t threads, double seconds)
+{
+	printf("%s\t%s\t%zu\t%zu\t%s%s%s\t%zu\t%.6f\n", label, corpus,
+	       state->input->len, state->bytes, phase, *variant ? "_" : "",
+	       variant, threads, seconds);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *label = "unknown";
+	size_t threads = 1;
+	int repeats = DEFAULT_REPEATS;
+	int opt;
+	while ((opt = getopt(argc, argv, "j:l:r:")) != -1) {
+		switch (opt) {
+		case 'j':
+			threads = strtoul(optarg, NULL, 10);
+			threads = threads ? threads : 1;
+			break;
+		case 'l':
+			label = optarg;
+			break;
+		case 'r':
+			repeats = atoi(optarg) > 0 ? atoi(optarg) : 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-j THREADS] [-l LABEL]"
+				" [-r REPEATS] CORPUS...\n", argv[0]);
+			return (1);
+		}
+	}
+	int null_fd = open("/dev/null", O_WRONLY);
+	struct output *out = output_create(null_fd);
+	if (null_fd < 0 || !out) {
+		fprintf(stderr, "Could not open /dev/null.\n");
+		return (2);
+	}
+	printf("label\tcorpus\twords\tbytes\tphase\tthreads\tseconds\n");
+	for (int file = optind; file < argc; ++file) {
+		const char *corpus = strrchr(argv[file], '/');
+		corpus = corpus ? corpus + 1 : argv[file];
+		int fd = open(argv[file], O_RDONLY);
+		struct stat file_stat;
+		if (fd < 0 || fstat(fd, &file_stat) < 0
+		    || file_stat.st_size == 0) {
+			fprintf(stderr, "%s could not be read.\n", argv[file]);
+			return (2);
+		}
+		size_t bytes = file_stat.st_size;
+		char *buf = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (buf == MAP_FAILED) {
+			fprintf(stderr, "%s could not be mapped.\n", argv[file]);
+			return (2);
+		}
+
+		struct bench_state state;
+		state.buf = buf;
+		state.bytes = bytes;
+		state.loaded.words = NULL;
+		state.loaded.len = 0;
+		state.loaded.max = 0;
+		state.counted.words = NULL;
+		state.counted.len = 0;
+		state.counted.max = 0;
+		state.input = &state.loaded;
+		state.threads = threads;
+		state.out = out;
+		report(label, corpus, &state, "load", "", 1,
+		       time_phase(&state, PHASE_LOAD, repeats));
+		size_t size = state.loaded.len * sizeof(*state.loaded.words);
+		state.sorted = malloc(size ? size : 1);
+		state.work = malloc(size ? size : 1);
+		struct arena *arena = arena_create();
+		if (!state.sorted || !state.work || !arena) {
+			fprintf(stderr, "Memory allocation error.\n");
+			return (3);
+		}
+		intern_words(&state, arena);
+		for (size_t i = 0; i < sizeof(sorts) / sizeof(*sorts); ++i) {
+			if (sorts[i].utf8 && !utf8_enabled() && !utf8_start()) {
+				fprintf(stderr, "No UTF-8 locale is available,"
+					" skipping %s.\n", sorts[i].name);
+				continue;
+			}
+			state.input = sorts[i].counted ? &state.counted
+			    : &state.loaded;
+			state.algorithm = sorts[i].algorithm;
+			state.case_insensitive = sorts[i].case_insensitive;
+			// Sorting first leaves state.sorted ready for -u
+			report(label, corpus, &state, "sort", sorts[i].name,
+			       threads, time_phase(&state, PHASE_SORT,
+						   repeats));
+			if (!sorts[i].counted) {
+				// Interned words are distinct already
+				report(label, corpus, &state, "unique",
+				       sorts[i].name, 1,
+				       time_phase(&state, PHASE_UNIQUE,
+						  repeats));
+			}
+			if (is_collation(sorts[i].algorithm)) {
+				// ws sorts in full rather than select when
+				// collating, so there is nothing more to time
+				continue;
+			}
+			report(label, corpus, &state, "top", sorts[i].name, 1,
+			       time_phase(&state, PHASE_TOP, repeats));
+			report(label, corpus, &state, "bottom", sorts[i].name,
+			       1, time_phase(&state, PHASE_BOTTOM, repeats));
+		}
+		state.input = &state.loaded;
+		report(label, corpus, &state, "scrabble_valid", "", 1,
+		       time_phase(&state, PHASE_SCRABBLE, repeats));
+		report(label, corpus, &state, "output", "", 1,
+		       time_phase(&state, PHASE_OUTPUT, repeats));
+		free(state.work);
+		free(state.sorted);
+		free(state.loaded.words);
+		free(state.counted.words);
+		arena_destroy(arena);
+		munmap(buf, bytes);
+	}
+	output_destroy(out);
+	close(null_fd);
+	return (0);
+}
@@ -0,0 +1,105 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Writes a deterministic synthetic corpus for make bench to standard
+// output. The same kind, word count and seed always give the same bytes,
+// so results stay comparable across commits and hosts.
+
+enum corpus_sizes {
+	MAX_WORD_LEN = 64,
+	WORDS_PER_LINE = 8,
+	VOCABULARY = 1000,	// Distinct words in the dupes corpus
+	PREFIX_LEN = 48,	// Shared part of each prefix corpus word
+	PREFIXES = 4
+};
+
+static uint64_t state;
+
+static uint64_t next_random(void)
+// xorshift64*, plenty for test data and identical on every platform.
+{
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return (state * 0x2545F4914F6CDD1DULL);
+}
+
+static size_t random_below(size_t bound)
+{
+	return (next_random() % bound);
+}
+
+static size_t random_word(char *buf, size_t min_len, size_t max_len,
+			  const char *alphabet)
+// Fills buf with a word of min_len to max_len letters of alphabet and
+// returns its length.
+{
+	size_t letters = strlen(alphabet);
+	size_t len = min_len + random_below(max_len - min_len + 1);
+	for (size_t i = 0; i < len; ++i) {
+		buf[i] = alphabet[random_below(letters)];
+	}
+	return (len);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *lower = "abcdefghijklmnopqrstuvwxyz";
+	const char *mixed =
+	    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	const char *digits = "0123456789";
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s uniform|prefix|numeric|dupes|mixed"
+			" WORDS [SEED]\n", argv[0]);
+		return (1);
+	}
+	const char *kind = argv[1];
+	size_t words = strtoull(argv[2], NULL, 10);
+	state = argc > 3 ? strtoull(argv[3], NULL, 10) : 1;
+	state = state ? state : 1;
+
+	char vocabulary[VOCABULARY][MAX_WORD_LEN];
+	size_t vocabulary_lens[VOCABULARY];
+	char prefixes[PREFIXES][PREFIX_LEN];
+	for (size_t i = 0; i < VOCABULARY; ++i) {
+		vocabulary_lens[i] = random_word(vocabulary[i], 1, 12, lower);
+	}
+	for (size_t i = 0; i < PREFIXES; ++i) {
+		random_word(prefixes[i], PREFIX_LEN, PREFIX_LEN, lower);
+	}
+
+	char buf[MAX_WORD_LEN + PREFIX_LEN];
+	for (size_t i = 0; i < words; ++i) {
+		size_t len = 0;
+		if (!strcmp(kind, "uniform")) {
+			len = random_word(buf, 1, 12, lower);
+		} else if (!strcmp(kind, "prefix")) {
+			memcpy(buf, prefixes[random_below(PREFIXES)],
+			       PREFIX_LEN);
+			len = PREFIX_LEN + random_word(buf + PREFIX_LEN, 0, 6,
+						       lower);
+		} else if (!strcmp(kind, "numeric")) {
+			if (random_below(10) == 0) {
+				buf[len++] = '-';
+			}
+			len += random_word(buf + len, 1, 18, digits);
+		} else if (!strcmp(kind, "dupes")) {
+			size_t pick = random_below(VOCABULARY);
+			len = vocabulary_lens[pick];
+			memcpy(buf, vocabulary[pick], len);
+		} else if (!strcmp(kind, "mixed")) {
+			len = random_word(buf, 1, 12, mixed);
+		} else {
+			fprintf(stderr, "%s is not a corpus kind.\n", kind);
+			return (1);
+		}
+		fwrite(buf, 1, len, stdout);
+		putchar((i + 1) % WORDS_PER_LINE ? ' ' : '\n');
+	}
+	if (words % WORDS_PER_LINE) {
+		putchar('\n');
+	}
+	return (0);
+}
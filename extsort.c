@@ -0,0 +1,384 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "extsort.h"
+
+FILE *ext_temp_file(void)
+// Returns a new temporary file open for reading and writing in $TMPDIR,
+// or /tmp if unset. The file is unlinked at once, so it disappears when
+// closed. Returns NULL on failure.
+{
+	const char *dir = getenv("TMPDIR");
+	if (!dir || !*dir) {
+		dir = "/tmp";
+	}
+	size_t path_len = strlen(dir) + sizeof("/ws.XXXXXX");
+	char *path = malloc(path_len);
+	if (!path) {
+		return (NULL);
+	}
+	snprintf(path, path_len, "%s/ws.XXXXXX", dir);
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		free(path);
+		return (NULL);
+	}
+	unlink(path);
+	free(path);
+	FILE *fo = fdopen(fd, "w+");
+	if (!fo) {
+		close(fd);
+	}
+	return (fo);
+}
+
+struct ext_sort *ext_create(int (*algorithm)(const void *, const void *))
+// Returns a pointer to an external sort with no runs that will merge
+// by algorithm, or NULL if out of memory.
+{
+	struct ext_sort *ext = calloc(1, sizeof(*ext));
+	if (!ext) {
+		return (NULL);
+	}
+	ext->algorithm = algorithm;
+	return (ext);
+}
+
+static bool write_word(FILE *fo, const struct word *word)
+{
+	return (fwrite(word->str, 1, word->len, fo) == word->len
+		&& putc('\n', fo) != EOF);
+}
+
+static bool finish_run(FILE *fo)
+// Flushes the run just written to fo and rewinds it for reading. On
+// failure fo is closed and false returned.
+{
+	if (fflush(fo) == EOF || ferror(fo)) {
+		fclose(fo);
+		return (false);
+	}
+	rewind(fo);
+	return (true);
+}
+
+static bool add_run(struct ext_sort *ext, FILE *fo)
+// Rewinds fo and appends it to the runs of ext as a run not yet merged.
+{
+	if (!finish_run(fo)) {
+		return (false);
+	}
+	if (ext->runs_len == ext->runs_max) {
+		size_t new_max = ext->runs_max ? 2 * ext->runs_max : 16;
+		FILE **tmp = realloc(ext->runs, new_max * sizeof(*tmp));
+		if (tmp) {
+			ext->runs = tmp;
+		}
+		size_t *levels = realloc(ext->levels,
+					 new_max * sizeof(*levels));
+		if (levels) {
+			ext->levels = levels;
+		}
+		if (!tmp || !levels) {
+			fclose(fo);
+			return (false);
+		}
+		ext->runs_max = new_max;
+	}
+	ext->runs[ext->runs_len] = fo;
+	ext->levels[ext->runs_len] = 0;
+	++ext->runs_len;
+	return (true);
+}
+
+static FILE *merge_group(struct ext_sort *ext, size_t start, size_t len);
+
+static bool cascade(struct ext_sort *ext)
+// Merges the last EXT_MAX_FANIN runs of ext into one whenever they have
+// all been through as many merges, as each new run is added. Levels
+// never rise from the first run to the last, so at most
+// EXT_MAX_FANIN - 1 runs of each level are left open, and each word
+// is rewritten once per level. Returns false on a memory or file error.
+{
+	while (ext->runs_len >= EXT_MAX_FANIN) {
+		size_t start = ext->runs_len - EXT_MAX_FANIN;
+		size_t level = ext->levels[ext->runs_len - 1];
+		if (ext->levels[start] != level) {
+			return (true);
+		}
+		FILE *fo = merge_group(ext, start, EXT_MAX_FANIN);
+		if (!fo) {
+			return (false);
+		}
+		ext->runs[start] = fo;
+		ext->levels[start] = level + 1;
+		ext->runs_len = start + 1;
+	}
+	return (true);
+}
+
+bool ext_write_run(struct ext_sort *ext, const struct word *words,
+		   size_t len)
+// Writes len already sorted words to a new temporary file as the next
+// run, merging earlier runs as cascade() needs. Returns false if the
+// run could not be written.
+{
+	FILE *fo = ext_temp_file();
+	if (!fo) {
+		return (false);
+	}
+	for (size_t i = 0; i < len; ++i) {
+		if (!write_word(fo, &words[i])) {
+			fclose(fo);
+			return (false);
+		}
+	}
+	return (add_run(ext, fo) && cascade(ext));
+}
+
+static bool heap_less(const struct ext_sort *ext, size_t reader_1,
+		      size_t reader_2)
+// Orders readers by their current word, then by run so that equal
+// words come out in input order.
+{
+	const struct ext_reader *first = &ext->readers[reader_1];
+	const struct ext_reader *second = &ext->readers[reader_2];
+	int result = ext->algorithm(&first->word, &second->word);
+	if (result) {
+		return (result < 0);
+	}
+	return (first->run < second->run);
+}
+
+static void sift_down(struct ext_sort *ext, size_t pos)
+{
+	for (;;) {
+		size_t smallest = pos;
+		size_t left = 2 * pos + 1;
+		size_t right = left + 1;
+		if (left < ext->heap_len
+		    && heap_less(ext, ext->heap[left], ext->heap[smallest])) {
+			smallest = left;
+		}
+		if (right < ext->heap_len
+		    && heap_less(ext, ext->heap[right], ext->heap[smallest])) {
+			smallest = right;
+		}
+		if (smallest == pos) {
+			return;
+		}
+		size_t tmp = ext->heap[pos];
+		ext->heap[pos] = ext->heap[smallest];
+		ext->heap[smallest] = tmp;
+		pos = smallest;
+	}
+}
+
+static int read_word(struct ext_reader *reader)
+// Reads the next word of reader's run. Returns 1 if a word was read,
+// 0 at the end of the run and -1 on a read error.
+{
+	ssize_t read = getline(&reader->line_buf, &reader->buf_size,
+			       reader->fo);
+	if (read < 0) {
+		return (ferror(reader->fo) ? -1 : 0);
+	}
+	reader->word.str = reader->line_buf;
+	reader->word.len = read - 1;	// Drop the newline
+	return (1);
+}
+
+static void close_readers(struct ext_sort *ext)
+{
+	if (!ext->readers) {
+		return;
+	}
+	for (size_t i = 0; i < ext->runs_len; ++i) {
+		free(ext->readers[i].line_buf);
+		if (ext->readers[i].fo) {
+			fclose(ext->readers[i].fo);
+		}
+	}
+	free(ext->readers);
+	free(ext->heap);
+	ext->readers = NULL;
+	ext->heap = NULL;
+	ext->heap_len = 0;
+	ext->runs_len = 0;
+}
+
+static bool open_readers(struct ext_sort *ext)
+// Builds a heap over the first word of every run, taking ownership of
+// the run files.
+{
+	ext->readers = calloc(ext->runs_len, sizeof(*ext->readers));
+	ext->heap = calloc(ext->runs_len, sizeof(*ext->heap));
+	if (!ext->readers || !ext->heap) {
+		return (false);
+	}
+	ext->heap_len = 0;
+	ext->advance_top = false;
+	for (size_t i = 0; i < ext->runs_len; ++i) {
+		ext->readers[i].fo = ext->runs[i];
+		ext->readers[i].run = i;
+		ext->runs[i] = NULL;
+		int result = read_word(&ext->readers[i]);
+		if (result < 0) {
+			return (false);
+		}
+		if (result > 0) {
+			ext->heap[ext->heap_len++] = i;
+		}
+	}
+	for (size_t i = ext->heap_len / 2; i > 0; --i) {
+		sift_down(ext, i - 1);
+	}
+	return (true);
+}
+
+int ext_next(struct ext_sort *ext, struct word *word)
+// Stores the next word of the merged runs in word, which stays valid
+// until the following call. Returns 1 if a word was stored, 0 once
+// every run is exhausted and -1 on a read error.
+{
+	if (ext->advance_top) {
+		ext->advance_top = false;
+		int result = read_word(&ext->readers[ext->heap[0]]);
+		if (result < 0) {
+			return (-1);
+		}
+		if (result == 0) {
+			ext->heap[0] = ext->heap[--ext->heap_len];
+		}
+		sift_down(ext, 0);
+	}
+	if (!ext->heap_len) {
+		return (0);
+	}
+	*word = ext->readers[ext->heap[0]].word;
+	ext->advance_top = true;
+	return (1);
+}
+
+static FILE *merge_group(struct ext_sort *ext, size_t start, size_t len)
+// Merges the len consecutive runs of ext from start into a new
+// temporary file, rewound for reading, and closes them. Equal words
+// stay in input order, as a merge of the result needs. Returns NULL on
+// a memory or file error, leaving the runs not yet closed to ext.
+{
+	struct ext_sort group = { ext->algorithm, ext->runs + start, NULL,
+		len, 0, NULL, NULL, 0, false
+	};
+	FILE *fo = ext_temp_file();
+	bool success = fo && open_readers(&group);
+	struct word word;
+	int result = 0;
+	while (success && (result = ext_next(&group, &word)) > 0) {
+		success = write_word(fo, &word);
+	}
+	close_readers(&group);
+	if (!success || result < 0) {
+		if (fo) {
+			fclose(fo);
+		}
+		return (NULL);
+	}
+	return (finish_run(fo) ? fo : NULL);
+}
+
+bool ext_merge_start(struct ext_sort *ext)
+// Prepares ext_next() to walk every run in merged order. Runs beyond
+// EXT_MAX_FANIN are first merged in groups of consecutive runs into
+// fewer, longer ones. Returns false on a memory or file error.
+{
+	while (ext->runs_len > EXT_MAX_FANIN) {
+		size_t merged = 0;
+		for (size_t start = 0; start < ext->runs_len;
+		     start += EXT_MAX_FANIN) {
+			size_t len = ext->runs_len - start;
+			if (len > EXT_MAX_FANIN) {
+				len = EXT_MAX_FANIN;
+			}
+			FILE *fo = merge_group(ext, start, len);
+			if (!fo) {
+				return (false);
+			}
+			ext->runs[merged++] = fo;
+		}
+		ext->runs_len = merged;
+	}
+	return (open_readers(ext));
+}
+
+void ext_destroy(struct ext_sort *ext)
+// Closes, and so deletes, every run and frees ext.
+{
+	if (!ext) {
+		return;
+	}
+	if (ext->readers) {
+		close_readers(ext);
+	}
+	for (size_t i = 0; i < ext->runs_len; ++i) {
+		if (ext->runs[i]) {
+			fclose(ext->runs[i]);
+		}
+	}
+	free(ext->runs);
+	free(ext->levels);
+	free(ext);
+}
+
+bool ext_print_reversed(FILE *fo, off_t start, off_t end,
+			struct output *out)
+// Queues the newline-terminated lines of fo between byte offsets start
+// and end on out, last line first, reading the file backwards in
+// blocks. Returns false on a memory or read error.
+{
+	size_t buf_max = EXT_BLOCK_SIZE;
+	char *buf = malloc(buf_max);
+	if (!buf) {
+		return (false);
+	}
+	size_t buf_len = 0;	// buf holds the bytes from pos up to here
+	off_t pos = end;
+	while (pos > start || buf_len) {
+		// Print every complete line after the first byte of buf
+		size_t line_end = buf_len;
+		for (size_t i = buf_len ? buf_len - 1 : 0; i-- > 0;) {
+			if (buf[i] == '\n') {
+				output_bytes(out, buf + i + 1,
+					     line_end - i - 1);
+				line_end = i + 1;
+			}
+		}
+		if (pos == start) {
+			// Case: What is left is the first line
+			output_bytes(out, buf, line_end);
+			break;
+		}
+		// Prepend the block before pos to the partial line left over
+		size_t block = EXT_BLOCK_SIZE;
+		if ((off_t)block > pos - start) {
+			block = pos - start;
+		}
+		if (block + line_end > buf_max) {
+			buf_max = 2 * (block + line_end);
+			char *tmp = realloc(buf, buf_max);
+			if (!tmp) {
+				free(buf);
+				return (false);
+			}
+			buf = tmp;
+		}
+		memmove(buf + block, buf, line_end);
+		pos -= block;
+		if (pread(fileno(fo), buf, block, pos) != (ssize_t)block) {
+			free(buf);
+			return (false);
+		}
+		buf_len = block + line_end;
+	}
+	free(buf);
+	return (true);
+}
@@ -0,0 +1,52 @@
+#ifndef EXTSORT_H
+#define EXTSORT_H
+
+#include <stdio.h>
+#include "output.h"
+#include "sort.h"
+
+enum ext_sizes {
+	EXT_MAX_FANIN = 64,	// Most runs merged at once; runs are merged
+	// in a cascade as they are written, so few files are open at any
+	// time
+	EXT_BLOCK_SIZE = 1 << 16	// Bytes read at a time when walking a
+	// temporary file backwards
+};
+
+struct ext_reader {
+	FILE *fo;
+	char *line_buf;
+	size_t buf_size;
+	struct word word;	// Current word, a view into line_buf
+	size_t run;		// Position of the run in input order
+};
+
+struct ext_sort {
+	int (*algorithm)(const void *, const void *);
+	FILE **runs;		// Sorted runs, one word per line
+	size_t *levels;		// Merges each run has been through
+	size_t runs_len;
+	size_t runs_max;
+	struct ext_reader *readers;
+	size_t *heap;		// Indices into readers, smallest word on top
+	size_t heap_len;
+	bool advance_top;	// Top reader's word was handed out last call
+};
+
+struct ext_sort *ext_create(int (*algorithm)(const void *, const void *));
+
+bool ext_write_run(struct ext_sort *ext, const struct word *words,
+		   size_t len);
+
+bool ext_merge_start(struct ext_sort *ext);
+
+int ext_next(struct ext_sort *ext, struct word *word);
+
+void ext_destroy(struct ext_sort *ext);
+
+FILE *ext_temp_file(void);
+
+bool ext_print_reversed(FILE *fo, off_t start, off_t end,
+			struct output *out);
+
+#endif
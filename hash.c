@@ -0,0 +1,130 @@
+#include "hash.h"
+#include "stats.h"
+#include "utf8.h"
+
+static size_t hash_word(const struct word *word, bool fold)
+// FNV-1a over the bytes of word, lowercased first if fold is set. In
+// UTF-8 mode folding is by code point, and the folded code points are
+// hashed instead.
+{
+	size_t hash = 14695981039346656037ULL;
+	if (fold && utf8_enabled()) {
+		for (size_t i = 0; i < word->len;) {
+			uint32_t code = utf8_fold(utf8_next(word->str,
+							    word->len, &i));
+			hash = (hash ^ code) * 1099511628211ULL;
+		}
+		return (hash);
+	}
+	for (size_t i = 0; i < word->len; ++i) {
+		unsigned char chr = word->str[i];
+		if (fold) {
+			chr = fold_byte(chr);
+		}
+		hash = (hash ^ chr) * 1099511628211ULL;
+	}
+	return (hash);
+}
+
+static bool words_equal(const struct word *word_1, const struct word *word_2,
+			bool fold)
+{
+	if (fold && utf8_enabled()) {
+		// Case: Folding may change how many bytes a character takes
+		return (!utf8_fold_compare(word_1->str, word_1->len,
+					   word_2->str, word_2->len));
+	}
+	if (word_1->len != word_2->len) {
+		return (false);
+	}
+	if (fold) {
+		return (!insensitive_ascii_sort(word_1, word_2));
+	}
+	return (!memcmp(word_1->str, word_2->str, word_1->len));
+}
+
+void word_set_init(struct word_set *set, bool fold)
+// Initializes an empty set. No memory is allocated until the first
+// insertion.
+{
+	set->entries = NULL;
+	set->capacity = 0;
+	set->len = 0;
+	set->generation = 1;
+	set->fold = fold;
+}
+
+static bool word_set_grow(struct word_set *set)
+// Doubles the capacity of set, rehashing every entry in use. Returns
+// false if out of memory.
+{
+	size_t new_capacity = set->capacity ? 2 * set->capacity :
+	    HASH_MIN_CAPACITY;
+	struct word_set_entry *entries = calloc(new_capacity,
+						sizeof(*entries));
+	if (!entries) {
+		return (false);
+	}
+	for (size_t i = 0; i < set->capacity; ++i) {
+		if (set->entries[i].generation != set->generation) {
+			continue;
+		}
+		size_t slot = set->entries[i].hash & (new_capacity - 1);
+		while (entries[slot].generation) {
+			slot = (slot + 1) & (new_capacity - 1);
+		}
+		entries[slot] = set->entries[i];
+		entries[slot].generation = 1;
+	}
+	stats_sample_heap();
+	free(set->entries);
+	set->entries = entries;
+	set->capacity = new_capacity;
+	set->generation = 1;
+	return (true);
+}
+
+struct word *word_set_insert(struct word_set *set, const struct word *word,
+			     bool *added)
+// Adds a view of word to set unless an equal word is already there.
+// Returns the view held by the set, which the caller may point at a
+// longer-lived copy of the same bytes, and sets added to whether word
+// was new. Returns NULL if out of memory.
+{
+	if (2 * (set->len + 1) > set->capacity && !word_set_grow(set)) {
+		return (NULL);
+	}
+	size_t hash = hash_word(word, set->fold);
+	size_t slot = hash & (set->capacity - 1);
+	while (set->entries[slot].generation == set->generation) {
+		if (set->entries[slot].hash == hash
+		    && words_equal(&set->entries[slot].word, word, set->fold)) {
+			*added = false;
+			return (&set->entries[slot].word);
+		}
+		slot = (slot + 1) & (set->capacity - 1);
+	}
+	set->entries[slot].word = *word;
+	set->entries[slot].hash = hash;
+	set->entries[slot].generation = set->generation;
+	++set->len;
+	*added = true;
+	return (&set->entries[slot].word);
+}
+
+void word_set_clear(struct word_set *set)
+// Empties set without touching its slots, by moving to a new
+// generation. Slots are only wiped when the generation wraps around.
+{
+	set->len = 0;
+	if (++set->generation == 0) {
+		memset(set->entries, 0, set->capacity * sizeof(*set->entries));
+		set->generation = 1;
+	}
+}
+
+void word_set_free(struct word_set *set)
+{
+	free(set->entries);
+	word_set_init(set, set->fold);
+}
@@ -0,0 +1,34 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include "sort.h"
+
+enum hash_sizes {
+	HASH_MIN_CAPACITY = 64	// Slots allocated by the first insertion
+};
+
+struct word_set_entry {
+	struct word word;
+	size_t hash;
+	unsigned int generation;	// Slot is in use only if this matches
+	// the set's generation
+};
+
+struct word_set {
+	struct word_set_entry *entries;
+	size_t capacity;	// Always a power of two
+	size_t len;
+	unsigned int generation;
+	bool fold;		// Compare and hash case-insensitively
+};
+
+void word_set_init(struct word_set *set, bool fold);
+
+struct word *word_set_insert(struct word_set *set, const struct word *word,
+			     bool *added);
+
+void word_set_clear(struct word_set *set);
+
+void word_set_free(struct word_set *set);
+
+#endif
@@ -0,0 +1,218 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "index.h"
+#include "output.h"
+
+static const char index_magic[INDEX_MAGIC_BYTES] = "WSINDEX";
+
+// Algorithms an index can be ordered by. Their position plus one is
+// stored in the low byte of the sort field, so entries are only ever
+// added at the end. count_sort is not among them: --build-index does
+// not take --count or --frequency.
+static int (*const index_algorithms[])(const void *, const void *) = {
+	ascii_sort, insensitive_ascii_sort, len_sort, num_sort,
+	big_num_sort, scrabble_sort, collate_sort, insensitive_collate_sort
+};
+
+uint32_t index_sort(int (*algorithm)(const void *, const void *),
+		    bool case_insensitive, bool scrabble_valid, bool utf8)
+// Describes the order of an index in one field: the algorithm the words
+// are sorted by and the options that decide which words are kept and
+// which count as duplicates. Indexes can only answer queries whose
+// description matches.
+{
+	uint32_t sort = 0;
+	size_t algorithms = sizeof(index_algorithms) /
+	    sizeof(*index_algorithms);
+	for (size_t i = 0; i < algorithms; ++i) {
+		if (index_algorithms[i] == algorithm) {
+			sort = i + 1;
+		}
+	}
+	if (case_insensitive) {
+		sort |= INDEX_CASE_INSENSITIVE;
+	}
+	if (scrabble_valid) {
+		sort |= INDEX_SCRABBLE_VALID;
+	}
+	if (utf8) {
+		sort |= INDEX_UTF8;
+	}
+	return (sort);
+}
+
+static void output_entry(struct output *out, uint64_t entry,
+			 size_t entry_bytes)
+// Queues entry for output as a table entry of entry_bytes bytes.
+{
+	if (entry_bytes == sizeof(uint32_t)) {
+		uint32_t narrow = entry;
+		output_bytes(out, (const char *)&narrow, sizeof(narrow));
+	} else {
+		output_bytes(out, (const char *)&entry, sizeof(entry));
+	}
+}
+
+static uint64_t table_entry(const char *table, size_t i, size_t entry_bytes)
+// Reads entry i of a mapped table of entry_bytes bytes per entry.
+{
+	if (entry_bytes == sizeof(uint32_t)) {
+		return (((const uint32_t *)table)[i]);
+	}
+	return (((const uint64_t *)table)[i]);
+}
+
+bool index_write(int fd, const struct word *words, size_t len,
+		 int (*algorithm)(const void *, const void *),
+		 bool case_insensitive, uint32_t sort)
+// Writes the len words, already sorted by algorithm, to fd as an index
+// described by sort. The unique table holds the positions of the words
+// filter_words() keeps for -u. Returns false with errno set if out of
+// memory or a write fails.
+{
+	struct word *kept = malloc((len ? len : 1) * sizeof(*kept));
+	struct output *out = output_create(fd);
+	size_t kept_len = len;
+	if (kept) {
+		memcpy(kept, words, len * sizeof(*kept));
+	}
+	if (!kept || !out
+	    || !filter_words(kept, &kept_len, false, true, algorithm,
+			     case_insensitive)) {
+		// Case: Out of memory
+		free(kept);
+		output_destroy(out);
+		errno = ENOMEM;
+		return (false);
+	}
+	struct index_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, index_magic, sizeof(header.magic));
+	header.version = INDEX_VERSION;
+	header.byte_order = INDEX_BYTE_ORDER;
+	header.sort = sort;
+	header.words = len;
+	header.unique = kept_len;
+	for (size_t i = 0; i < len; ++i) {
+		header.blob_bytes += words[i].len;
+	}
+	// Positions are below len, so the offsets decide
+	header.entry_bytes = header.blob_bytes <= UINT32_MAX
+	    ? sizeof(uint32_t) : sizeof(uint64_t);
+	output_bytes(out, (const char *)&header, sizeof(header));
+
+	uint64_t offset = 0;
+	output_entry(out, offset, header.entry_bytes);
+	for (size_t i = 0; i < len; ++i) {
+		offset += words[i].len;
+		output_entry(out, offset, header.entry_bytes);
+	}
+	// The kept views are a subsequence of words, so one pass over both
+	// finds where each came from
+	for (size_t i = 0, j = 0; i < len && j < kept_len; ++i) {
+		if (words[i].str == kept[j].str && words[i].len == kept[j].len) {
+			output_entry(out, i, header.entry_bytes);
+			++j;
+		}
+	}
+	for (size_t i = 0; i < len; ++i) {
+		output_bytes(out, words[i].str, words[i].len);
+	}
+	free(kept);
+	bool flushed = output_flush(out);
+	output_destroy(out);
+	return (flushed);
+}
+
+bool index_open(struct word_index *index, int fd)
+// Maps the index file open on fd and checks that its header and the
+// sizes of its tables agree with its length, so that index_word()
+// never reads outside it. Returns false with errno set if it cannot be
+// mapped, or set to EINVAL if it is not an index this ws can read.
+{
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) < 0) {
+		return (false);
+	}
+	if (!S_ISREG(file_stat.st_mode)
+	    || (size_t)file_stat.st_size < sizeof(struct index_header)) {
+		errno = EINVAL;
+		return (false);
+	}
+	size_t len = file_stat.st_size;
+	void *addr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (addr == MAP_FAILED) {
+		return (false);
+	}
+	const struct index_header *header = addr;
+	const char *offsets = (const char *)(header + 1);
+	size_t entry_bytes = header->entry_bytes;
+	// Bounding words and unique first keeps the sum from overflowing
+	bool valid = !memcmp(header->magic, index_magic, sizeof(index_magic))
+	    && header->version == INDEX_VERSION
+	    && header->byte_order == INDEX_BYTE_ORDER
+	    && (entry_bytes == sizeof(uint32_t)
+		|| entry_bytes == sizeof(uint64_t))
+	    && header->words < len / entry_bytes
+	    && header->unique <= header->words
+	    && header->blob_bytes <= len
+	    && sizeof(*header) + (header->words + 1 + header->unique)
+	    * entry_bytes + header->blob_bytes == len;
+	if (valid) {
+		valid = table_entry(offsets, 0, entry_bytes) == 0
+		    && table_entry(offsets, header->words, entry_bytes)
+		    == header->blob_bytes;
+	}
+	if (!valid) {
+		munmap(addr, len);
+		errno = EINVAL;
+		return (false);
+	}
+	index->addr = addr;
+	index->len = len;
+	index->sort = header->sort;
+	index->words = header->words;
+	index->unique = header->unique;
+	index->entry_bytes = entry_bytes;
+	index->offsets = offsets;
+	index->positions = offsets + (header->words + 1) * entry_bytes;
+	index->blob = index->positions + header->unique * entry_bytes;
+	index->blob_bytes = header->blob_bytes;
+	return (true);
+}
+
+bool index_word(const struct word_index *index, size_t i, bool unique,
+		struct word *word)
+// Stores a view of word i of the index in word: of all its words, or
+// of only the unique ones if unique is set. i must be below
+// index->words or index->unique to match. Returns false if the tables
+// point outside the blob.
+{
+	uint64_t entry = i;
+	if (unique) {
+		entry = table_entry(index->positions, i, index->entry_bytes);
+		if (entry >= index->words) {
+			return (false);
+		}
+	}
+	uint64_t start = table_entry(index->offsets, entry, index->entry_bytes);
+	uint64_t end = table_entry(index->offsets, entry + 1,
+				   index->entry_bytes);
+	if (start > end || end > index->blob_bytes) {
+		return (false);
+	}
+	word->str = index->blob + start;
+	word->len = end - start;
+	return (true);
+}
+
+void index_close(struct word_index *index)
+// Unmaps the index file.
+{
+	munmap(index->addr, index->len);
+	index->addr = NULL;
+	index->len = 0;
+}
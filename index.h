@@ -0,0 +1,68 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sort.h"
+
+enum index_sizes {
+	INDEX_MAGIC_BYTES = 8,
+	INDEX_VERSION = 1,	// Raised whenever the layout changes
+	INDEX_BYTE_ORDER = 0x01020304	// Reads back differently on a
+	// machine of the other byte order
+};
+
+enum index_flags {
+	INDEX_CASE_INSENSITIVE = 1 << 8,	// Low byte is the algorithm
+	INDEX_SCRABBLE_VALID = 1 << 9,
+	INDEX_UTF8 = 1 << 10
+};
+
+// An index file is this header, then words + 1 offsets into the blob
+// (word i is the bytes from offset i up to offset i + 1), then the
+// positions of the unique words, then the blob of sorted words back to
+// back. Table entries take 4 bytes when every offset fits, else 8.
+// Every field is in the byte order of the machine that wrote it, and
+// the tables are aligned to their entries so the file can be used
+// mapped.
+struct index_header {
+	char magic[INDEX_MAGIC_BYTES];	// "WSINDEX" and a NUL
+	uint32_t version;
+	uint32_t byte_order;	// INDEX_BYTE_ORDER
+	uint32_t sort;		// How the words are ordered, index_sort()
+	uint32_t entry_bytes;	// Of each table entry, 4 or 8
+	uint64_t words;
+	uint64_t unique;	// Positions of the first of each set of
+	// duplicates, as -u keeps them
+	uint64_t blob_bytes;
+};
+
+struct word_index {
+	void *addr;		// The whole file, mapped
+	size_t len;
+	uint32_t sort;
+	size_t words;
+	size_t unique;
+	size_t entry_bytes;
+	const char *offsets;
+	const char *positions;	// Of the unique words
+	const char *blob;
+	size_t blob_bytes;
+};
+
+uint32_t index_sort(int (*algorithm)(const void *, const void *),
+		    bool case_insensitive, bool scrabble_valid, bool utf8);
+
+bool index_write(int fd, const struct word *words, size_t len,
+		 int (*algorithm)(const void *, const void *),
+		 bool case_insensitive, uint32_t sort);
+
+bool index_open(struct word_index *index, int fd);
+
+bool index_word(const struct word_index *index, size_t i, bool unique,
+		struct word *word);
+
+void index_close(struct word_index *index);
+
+#endif
@@ -0,0 +1,220 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "input.h"
+#include "tokenize.h"
+#include "utf8.h"
+
+struct input_carry {
+	char *data;		// Start of a word cut off by the end of a
+	// block, copied out so the block can be reused
+	size_t len;
+	size_t max;
+	bool skipping;		// A NUL was seen, drop bytes up to the
+	// next newline
+};
+
+static void fill_block(struct input_ring *ring, struct input_block *block)
+// Reads into block until it is full or the input ends.
+{
+	block->len = 0;
+	block->last = false;
+	while (block->len < INPUT_BLOCK_SIZE) {
+		ssize_t got = read(ring->fd, block->data + block->len,
+				   INPUT_BLOCK_SIZE - block->len);
+		if (got < 0 && errno == EINTR) {
+			continue;
+		}
+		if (got <= 0) {
+			if (got < 0) {
+				ring->error = errno;
+			}
+			block->last = true;
+			return;
+		}
+		block->len += got;
+	}
+}
+
+static void *reader(void *ring_ptr)
+// Thread body filling the blocks of the ring in turn, each as soon as
+// the tokenizer hands it back.
+{
+	struct input_ring *ring = ring_ptr;
+	for (size_t i = 0;; i = (i + 1) % INPUT_BLOCKS) {
+		struct input_block *block = &ring->blocks[i];
+		pthread_mutex_lock(&ring->lock);
+		while (block->full) {
+			pthread_cond_wait(&ring->changed, &ring->lock);
+		}
+		pthread_mutex_unlock(&ring->lock);
+		fill_block(ring, block);
+		pthread_mutex_lock(&ring->lock);
+		block->full = true;
+		pthread_cond_broadcast(&ring->changed);
+		pthread_mutex_unlock(&ring->lock);
+		if (block->last) {
+			return (NULL);
+		}
+	}
+}
+
+static bool carry_append(struct input_carry *carry, const char *str,
+			 size_t len)
+// Appends len bytes of str to the carried word, growing it
+// geometrically. Returns false if out of memory.
+{
+	if (len > carry->max - carry->len) {
+		size_t new_max = 2 * (carry->len + len);
+		char *tmp = realloc(carry->data, new_max);
+		if (!tmp) {
+			return (false);
+		}
+		carry->data = tmp;
+		carry->max = new_max;
+	}
+	memcpy(carry->data + carry->len, str, len);
+	carry->len += len;
+	return (true);
+}
+
+static bool tokenize_block(struct input_carry *carry,
+			   const struct input_block *block,
+			   void (*emit)(void *, const char *, size_t),
+			   void *ctx)
+// Passes every word of block to emit, finishing the word carried over
+// from the block before and carrying out any word the block cuts off.
+// Returns false if out of memory.
+{
+	const char *data = block->data;
+	size_t pos = 0;
+	if (carry->skipping) {
+		const char *newline = memchr(data, '\n', block->len);
+		if (!newline) {
+			// Case: Whole block is in the dropped line
+			return (true);
+		}
+		pos = newline - data;
+		carry->skipping = false;
+	}
+	if (carry->len) {
+		size_t end = pos;
+		while (end < block->len && data[end] != ' '
+		       && (data[end] < '\t' || data[end] > '\r')
+		       && data[end] != '\0') {
+			++end;
+		}
+		if (!carry_append(carry, data + pos, end - pos)) {
+			return (false);
+		}
+		if (end == block->len && !block->last) {
+			// Case: Word runs on into the next block as well
+			return (true);
+		}
+		emit(ctx, carry->data, carry->len);
+		carry->len = 0;
+		pos = end;
+	}
+	pos += tokenize(data + pos, block->len - pos, block->last, emit, ctx);
+	if (pos == block->len) {
+		return (true);
+	}
+	if (data[pos] == '\0') {
+		carry->skipping = true;
+		return (true);
+	}
+	return (carry_append(carry, data + pos, block->len - pos));
+}
+
+bool input_read(int fd, void (*emit)(void *, const char *, size_t),
+		void (*split)(void *, const char *, size_t), void *ctx)
+// Reads fd to its end in large blocks, passing each word found to emit
+// along with ctx. The words point into a buffer that is reused once
+// emit returns, so emit must copy them. Reading runs on a thread of
+// its own, so the next block is read while one is tokenized. If split
+// is set, each block is validated as UTF-8 before it is tokenized, and
+// from the first that holds Unicode whitespace on, words go to split
+// instead. Returns false on a read error, with errno set, if out of
+// memory, or with errno set to EILSEQ if the input is not UTF-8.
+{
+	struct input_ring ring;
+	struct input_carry carry = { NULL, 0, 0, false };
+	struct utf8_stream stream = { { 0 }, 0 };
+	ring.fd = fd;
+	ring.error = 0;
+	bool success = true;
+	for (size_t i = 0; i < INPUT_BLOCKS; ++i) {
+		ring.blocks[i].data = malloc(INPUT_BLOCK_SIZE);
+		ring.blocks[i].full = false;
+		success = success && ring.blocks[i].data;
+	}
+	if (!success) {
+		for (size_t i = 0; i < INPUT_BLOCKS; ++i) {
+			free(ring.blocks[i].data);
+		}
+		errno = ENOMEM;
+		return (false);
+	}
+	pthread_mutex_init(&ring.lock, NULL);
+	pthread_cond_init(&ring.changed, NULL);
+	pthread_t id;
+	bool threaded = !pthread_create(&id, NULL, reader, &ring);
+
+	bool out_of_memory = false;
+	bool invalid = false;
+	bool spaces = false;
+	bool last = false;
+	for (size_t i = 0; !last; i = (i + 1) % INPUT_BLOCKS) {
+		struct input_block *block = &ring.blocks[i];
+		if (threaded) {
+			pthread_mutex_lock(&ring.lock);
+			while (!block->full) {
+				pthread_cond_wait(&ring.changed, &ring.lock);
+			}
+			pthread_mutex_unlock(&ring.lock);
+		} else {
+			// Case: No thread to spare, read in turn
+			fill_block(&ring, block);
+		}
+		last = block->last;
+		if (split && !invalid
+		    && !utf8_valid_stream(&stream, block->data, block->len,
+					  last, &spaces)) {
+			invalid = true;
+		}
+		if (!out_of_memory && !invalid
+		    && !tokenize_block(&carry, block, spaces ? split : emit,
+				       ctx)) {
+			// Keep handing blocks back so the reader can finish
+			out_of_memory = true;
+		}
+		pthread_mutex_lock(&ring.lock);
+		block->full = false;
+		pthread_cond_broadcast(&ring.changed);
+		pthread_mutex_unlock(&ring.lock);
+	}
+
+	if (threaded) {
+		pthread_join(id, NULL);
+	}
+	pthread_cond_destroy(&ring.changed);
+	pthread_mutex_destroy(&ring.lock);
+	for (size_t i = 0; i < INPUT_BLOCKS; ++i) {
+		free(ring.blocks[i].data);
+	}
+	free(carry.data);
+	if (out_of_memory) {
+		errno = ENOMEM;
+		return (false);
+	}
+	if (invalid) {
+		errno = EILSEQ;
+		return (false);
+	}
+	if (ring.error) {
+		errno = ring.error;
+		return (false);
+	}
+	return (true);
+}
@@ -0,0 +1,32 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+enum input_sizes {
+	INPUT_BLOCKS = 2,	// Blocks in the ring, one being read while
+	// the other is tokenized
+	INPUT_BLOCK_SIZE = 1 << 20	// Bytes read into each block
+};
+
+struct input_block {
+	char *data;
+	size_t len;
+	bool full;		// Read and waiting to be tokenized
+	bool last;		// Ends the input, by end of file or error
+};
+
+struct input_ring {
+	int fd;
+	struct input_block blocks[INPUT_BLOCKS];
+	int error;		// errno of a failed read, else 0
+	pthread_mutex_t lock;	// Guards the full flags of blocks
+	pthread_cond_t changed;	// Signalled whenever a full flag flips
+};
+
+bool input_read(int fd, void (*emit)(void *, const char *, size_t),
+		void (*split)(void *, const char *, size_t), void *ctx);
+
+#endif
@@ -0,0 +1,118 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "output.h"
+
+static void write_all(struct output *out, const char *str, size_t len)
+// Writes len bytes of str to the output's file descriptor, retrying
+// short and interrupted writes. Any other error marks out as failed.
+{
+	while (len > 0 && !out->failed) {
+		ssize_t written = write(out->fd, str, len);
+		if (written < 0) {
+			if (errno != EINTR) {
+				out->failed = true;
+			}
+			continue;
+		}
+		str += written;
+		len -= written;
+	}
+}
+
+struct output *output_create(int fd)
+// Returns a pointer to a new, empty output buffer writing to fd, or
+// NULL if out of memory.
+{
+	struct output *out = malloc(sizeof(*out));
+	if (!out) {
+		return (NULL);
+	}
+	out->fd = fd;
+	out->len = 0;
+	out->failed = false;
+	return (out);
+}
+
+void output_bytes(struct output *out, const char *str, size_t len)
+// Queues len bytes of str for output. Nothing reaches the file
+// descriptor until the buffer fills or output_flush() is called.
+{
+	if (len > OUTPUT_BUFFER_SIZE - out->len) {
+		// Case: Buffer would overflow, empty it first
+		write_all(out, out->buf, out->len);
+		out->len = 0;
+		if (len >= OUTPUT_BUFFER_SIZE) {
+			write_all(out, str, len);
+			return;
+		}
+	}
+	memcpy(out->buf + out->len, str, len);
+	out->len += len;
+}
+
+void output_word(struct output *out, const struct word *word)
+// Queues word followed by a newline for output.
+{
+	if (word->len < OUTPUT_BUFFER_SIZE - out->len) {
+		// Case: Common path, the word and its newline fit
+		memcpy(out->buf + out->len, word->str, word->len);
+		out->len += word->len;
+		out->buf[out->len++] = '\n';
+		return;
+	}
+	output_bytes(out, word->str, word->len);
+	output_bytes(out, "\n", 1);
+}
+
+static void output_count(struct output *out, size_t count)
+// Queues count in decimal followed by a space for output.
+{
+	char digits[OUTPUT_COUNT_DIGITS];
+	size_t start = sizeof(digits);
+	digits[--start] = ' ';
+	do {
+		digits[--start] = '0' + count % 10;
+		count /= 10;
+	} while (count);
+	output_bytes(out, digits + start, sizeof(digits) - start);
+}
+
+void output_words(struct output *out, const struct word *words, size_t len,
+		  bool reversed, bool counted)
+// Queues the len words of the words array for output, one per line,
+// last to first if reversed is set. If counted is set the words were
+// interned by --count and each line starts with the word's count.
+{
+	if (!reversed) {
+		for (size_t i = 0; i < len; ++i) {
+			if (counted) {
+				output_count(out, word_count(&words[i]));
+			}
+			output_word(out, &words[i]);
+		}
+	} else {
+		for (size_t i = len; i > 0; --i) {
+			if (counted) {
+				output_count(out, word_count(&words[i - 1]));
+			}
+			output_word(out, &words[i - 1]);
+		}
+	}
+}
+
+bool output_flush(struct output *out)
+// Writes everything queued so far. Returns false if this or any
+// earlier write failed.
+{
+	write_all(out, out->buf, out->len);
+	out->len = 0;
+	return (!out->failed);
+}
+
+void output_destroy(struct output *out)
+// Releases the output buffer without flushing it.
+{
+	free(out);
+}
@@ -0,0 +1,35 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "sort.h"
+
+enum output_sizes {
+	OUTPUT_BUFFER_SIZE = 1 << 17,	// Bytes gathered before each write;
+	// longer words are written straight from where they live
+	OUTPUT_COUNT_DIGITS = 21	// Digits of the largest 64-bit count
+	// and the space after it
+};
+
+struct output {
+	int fd;
+	size_t len;		// Bytes waiting in buf
+	bool failed;		// A write has failed; later output is dropped
+	char buf[OUTPUT_BUFFER_SIZE];
+};
+
+struct output *output_create(int fd);
+
+void output_bytes(struct output *out, const char *str, size_t len);
+
+void output_word(struct output *out, const struct word *word);
+
+void output_words(struct output *out, const struct word *words, size_t len,
+		  bool reversed, bool counted);
+
+bool output_flush(struct output *out);
+
+void output_destroy(struct output *out);
+
+#endif
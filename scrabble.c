@@ -0,0 +1,93 @@
+#include <stdint.h>
+#include "scrabble.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Histogram bin of each byte: 1 to 26 for the letters a to z in either
+// case, 0 for every other byte.
+#define LETTER(c) [c] = c - 'a' + 1, [c - 'a' + 'A'] = c - 'a' + 1
+static const uint8_t letter_bin[256] = {
+	LETTER('a'), LETTER('b'), LETTER('c'), LETTER('d'), LETTER('e'),
+	LETTER('f'), LETTER('g'), LETTER('h'), LETTER('i'), LETTER('j'),
+	LETTER('k'), LETTER('l'), LETTER('m'), LETTER('n'), LETTER('o'),
+	LETTER('p'), LETTER('q'), LETTER('r'), LETTER('s'), LETTER('t'),
+	LETTER('u'), LETTER('v'), LETTER('w'), LETTER('x'), LETTER('y'),
+	LETTER('z')
+};
+#undef LETTER
+
+// Number of tiles and points per tile of each bin in English Scrabble.
+// No bin holds more than 12 tiles, and no bin's tiles are worth more
+// than 12 points in total, so everything below fits in a byte.
+static const uint8_t bin_tiles[SCRABBLE_BINS] = {
+	0, 9, 2, 2, 4, 12, 2, 3, 2, 9, 1, 1, 4, 2,
+	6, 8, 2, 1, 6, 4, 6, 4, 2, 2, 1, 2, 1
+};
+
+static const uint8_t bin_points[SCRABBLE_BINS] = {
+	0, 1, 3, 3, 2, 1, 4, 2, 4, 1, 8, 5, 1, 3,
+	1, 1, 3, 10, 1, 1, 1, 1, 4, 4, 8, 4, 10
+};
+
+int scrabble_score(const char *str, size_t len, bool *valid)
+// Scores the len bytes at str in Scrabble and, if valid is not NULL,
+// sets *valid to whether they can be spelled with one set of tiles,
+// blanks included. Bytes other than letters score nothing and make the
+// word invalid; letters past the tiles of their kind score nothing.
+// Each bin counts up to 255 and then stays there: a bin that full is
+// past any allotment, so the score and validity are still exact.
+{
+	uint8_t counts[SCRABBLE_BINS] __attribute__((aligned(16))) = { 0 };
+	for (size_t i = 0; i < len; ++i) {
+		uint8_t *count = &counts[letter_bin[(unsigned char)str[i]]];
+		*count += *count != UINT8_MAX;
+	}
+#ifdef __SSE2__
+	// score is the sum of min(count, tiles) * points over the bins and
+	// excess that of count - tiles where count is more than tiles
+	const __m128i zero = _mm_setzero_si128();
+	__m128i score = zero;
+	__m128i excess = zero;
+	for (size_t i = 0; i < SCRABBLE_BINS; i += 16) {
+		__m128i count = _mm_load_si128((const __m128i *)(counts + i));
+		__m128i tiles = _mm_loadu_si128((const __m128i *)
+						(bin_tiles + i));
+		__m128i points = _mm_loadu_si128((const __m128i *)
+						 (bin_points + i));
+		__m128i used = _mm_min_epu8(count, tiles);
+		// used * points is at most 12, so packing the 16-bit
+		// products back into bytes loses nothing
+		__m128i low = _mm_mullo_epi16(_mm_unpacklo_epi8(used, zero),
+					      _mm_unpacklo_epi8(points, zero));
+		__m128i high = _mm_mullo_epi16(_mm_unpackhi_epi8(used, zero),
+					       _mm_unpackhi_epi8(points, zero));
+		score = _mm_add_epi64(score,
+				      _mm_sad_epu8(_mm_packus_epi16(low, high),
+						   zero));
+		excess = _mm_add_epi64(excess,
+				       _mm_sad_epu8(_mm_subs_epu8(count, tiles),
+						    zero));
+	}
+	score = _mm_add_epi64(score, _mm_unpackhi_epi64(score, score));
+	excess = _mm_add_epi64(excess, _mm_unpackhi_epi64(excess, excess));
+	if (valid) {
+		*valid = !counts[0]
+		    && _mm_cvtsi128_si32(excess) <= SCRABBLE_BLANKS;
+	}
+	return (_mm_cvtsi128_si32(score));
+#else
+	int score = 0;
+	int excess = 0;
+	for (size_t i = 0; i < SCRABBLE_BINS; ++i) {
+		int used = counts[i] < bin_tiles[i] ? counts[i] : bin_tiles[i];
+		score += used * bin_points[i];
+		excess += counts[i] - used;
+	}
+	if (valid) {
+		*valid = !counts[0] && excess <= SCRABBLE_BLANKS;
+	}
+	return (score);
+#endif
+}
@@ -0,0 +1,14 @@
+#ifndef SCRABBLE_H
+#define SCRABBLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+enum scrabble_sizes {
+	SCRABBLE_BINS = 32,	// Histogram bins: non-letters, a to z, padding
+	SCRABBLE_BLANKS = 2	// Blank tiles in one set
+};
+
+int scrabble_score(const char *str, size_t len, bool *valid);
+
+#endif
@@ -1,24 +1,112 @@
+#include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "arena.h"
+#include "hash.h"
+#include "scrabble.h"
 #include "sort.h"
+#include "stats.h"
+#include "utf8.h"
+
+static int fold_compare(const char *str_1, const char *str_2, size_t len)
+// Compares the len bytes at str_1 and str_2 as they are after
+// fold_byte(). Bytes that are equal fold equally, so only mismatches
+// are folded, and equal stretches are skipped 8 bytes at a time where
+// bytes can be loaded that way.
+{
+	size_t i = 0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	while (i + sizeof(uint64_t) <= len) {
+		uint64_t chunk_1;
+		uint64_t chunk_2;
+		memcpy(&chunk_1, str_1 + i, sizeof(chunk_1));
+		memcpy(&chunk_2, str_2 + i, sizeof(chunk_2));
+		uint64_t diff = chunk_1 ^ chunk_2;
+		if (!diff) {
+			i += sizeof(uint64_t);
+			continue;
+		}
+		// The lowest set bit is in the first differing byte
+		i += __builtin_ctzll(diff) / CHAR_BIT;
+		int chr_1 = fold_byte(str_1[i]);
+		int chr_2 = fold_byte(str_2[i]);
+		if (chr_1 != chr_2) {
+			return (chr_1 - chr_2);
+		}
+		++i;
+	}
+#endif
+	for (; i < len; ++i) {
+		int chr_1 = (unsigned char)str_1[i];
+		int chr_2 = (unsigned char)str_2[i];
+		if (chr_1 != chr_2) {
+			chr_1 = fold_byte(chr_1);
+			chr_2 = fold_byte(chr_2);
+			if (chr_1 != chr_2) {
+				return (chr_1 - chr_2);
+			}
+		}
+	}
+	return (0);
+}
 
 int ascii_sort(const void *str_1, const void *str_2)
 // Sort two strings by ASCII codepoint in ascending order
 {
-	// Syntax from stackoverflow.com/a/5484006 from jxh
-	return (strcmp(*(char *const *)str_1, *(char *const *)str_2));
+	stats_count_comparison();
+	const struct word *word_1 = str_1;
+	const struct word *word_2 = str_2;
+	size_t len = word_1->len < word_2->len ? word_1->len : word_2->len;
+	int result = memcmp(word_1->str, word_2->str, len);
+	if (result || word_1->len == word_2->len) {
+		return (result);
+	}
+	return (word_1->len > word_2->len ? 1 : -1);
 }
 
 int insensitive_ascii_sort(const void *str_1, const void *str_2)
 // Sort two strings by ASCII codepoint in ascending order,
 // case insensitively
 {
-	return (strcasecmp(*(char *const *)str_1, *(char *const *)str_2));
+	stats_count_comparison();
+	const struct word *word_1 = str_1;
+	const struct word *word_2 = str_2;
+	size_t len = word_1->len < word_2->len ? word_1->len : word_2->len;
+	int result = fold_compare(word_1->str, word_2->str, len);
+	if (result || word_1->len == word_2->len) {
+		return (result);
+	}
+	return (word_1->len > word_2->len ? 1 : -1);
+}
+
+int collate_sort(const void *str_1, const void *str_2)
+// Sort two UTF-8 strings by the collation of the locale in ascending
+// order
+{
+	stats_count_comparison();
+	const struct word *word_1 = str_1;
+	const struct word *word_2 = str_2;
+	return (utf8_collate(word_1->str, word_1->len, word_2->str,
+			     word_2->len, false));
+}
+
+int insensitive_collate_sort(const void *str_1, const void *str_2)
+// Sort two UTF-8 strings by the collation of the locale in ascending
+// order, case insensitively
+{
+	stats_count_comparison();
+	const struct word *word_1 = str_1;
+	const struct word *word_2 = str_2;
+	return (utf8_collate(word_1->str, word_1->len, word_2->str,
+			     word_2->len, true));
 }
 
 int len_sort(const void *str_1, const void *str_2)
 // Sort two strings by length in ascending order.
 {
-	size_t len_1 = strlen(*(char *const *)str_1);
-	size_t len_2 = strlen(*(char *const *)str_2);
+	stats_count_comparison();
+	size_t len_1 = ((const struct word *)str_1)->len;
+	size_t len_2 = ((const struct word *)str_2)->len;
 	if (len_1 == len_2) {
 		return (0);
 	}
@@ -30,18 +118,72 @@ int num_sort(const void *str_1, const void *str_2)
 // ascending order, ignoring values after the first
 // non-digit character in a given string.
 {
-	long int num_1 = strtol(*(char *const *)str_1, NULL, 10);
-	long int num_2 = strtol(*(char *const *)str_2, NULL, 10);
+	stats_count_comparison();
+	long int num_1 = word_to_long(str_1);
+	long int num_2 = word_to_long(str_2);
 	if (num_1 == num_2) {
 		return (0);
 	}
 	return (num_1 > num_2 ? 1 : -1);
 }
 
+static void parse_integer(const struct word *word, bool *negative,
+			  const char **digits, size_t *len)
+// Finds the leading base-10 number of word the way word_to_long() does,
+// but at any length: sets *digits and *len to its digits without
+// leading zeros and *negative to whether it is below zero.
+{
+	size_t i = 0;
+	*negative = false;
+	if (i < word->len && (word->str[i] == '+' || word->str[i] == '-')) {
+		*negative = word->str[i] == '-';
+		++i;
+	}
+	while (i < word->len && word->str[i] == '0') {
+		++i;
+	}
+	*digits = word->str + i;
+	while (i < word->len && isdigit((unsigned char)word->str[i])) {
+		++i;
+	}
+	*len = word->str + i - *digits;
+	if (*len == 0) {
+		// Case: -0 is 0
+		*negative = false;
+	}
+}
+
+int big_num_sort(const void *str_1, const void *str_2)
+// Sorts two strings as num_sort does, but comparing numbers of any
+// length exactly instead of saturating them at LONG_MIN and LONG_MAX.
+{
+	stats_count_comparison();
+	bool negative_1;
+	bool negative_2;
+	const char *digits_1;
+	const char *digits_2;
+	size_t len_1;
+	size_t len_2;
+	parse_integer(str_1, &negative_1, &digits_1, &len_1);
+	parse_integer(str_2, &negative_2, &digits_2, &len_2);
+	if (negative_1 != negative_2) {
+		return (negative_1 ? -1 : 1);
+	}
+	int result;
+	if (len_1 != len_2) {
+		result = len_1 > len_2 ? 1 : -1;
+	} else {
+		result = memcmp(digits_1, digits_2, len_1);
+		result = (result > 0) - (result < 0);
+	}
+	return (negative_1 ? -result : result);
+}
+
 int scrabble_sort(const void *str_1, const void *str_2)
 // Sort two strings by score in scrabble in ascending order.
 // Does no validation.
 {
+	stats_count_comparison();
 	int num_1 = scrabble_sort_helper(str_1);
 	int num_2 = scrabble_sort_helper(str_2);
 	if (num_1 == num_2) {
@@ -50,54 +192,1118 @@ int scrabble_sort(const void *str_1, const void *str_2)
 	return (num_1 > num_2 ? 1 : -1);
 }
 
+int count_sort(const void *str_1, const void *str_2)
+// Sorts two words interned by --count by their number of occurrences
+// in ascending order.
+{
+	stats_count_comparison();
+	size_t count_1 = word_count(str_1);
+	size_t count_2 = word_count(str_2);
+	if (count_1 == count_2) {
+		return (0);
+	}
+	return (count_1 > count_2 ? 1 : -1);
+}
+
 int scrabble_sort_helper(const void *str)
+// Returns the Scrabble score of the struct word at str.
 {
-	// Number of tiles in English Scrabble
-	//for each letter in the alphabet, in order
-	int num_tiles[26] = { 9, 2, 2, 4, 12, 2, 3, 2, 9, 1,
-		1, 4, 2, 6, 8, 2, 1, 6, 4, 6,
-		4, 2, 2, 1, 2, 1
-	};
-	int score = 0;
-	for (size_t i = 0; i < strlen(*(char *const *)str); ++i) {
-		char tmp = tolower(*(* (char *const *)str + i));
-		if (!isalpha(tmp)) {
+	const struct word *word = str;
+	return (scrabble_score(word->str, word->len, NULL));
+}
+
+long int word_to_long(const struct word *word)
+// Converts the leading base-10 number of word the way strtol() does,
+// saturating at LONG_MIN and LONG_MAX. Words are not NUL-terminated,
+// so strtol() itself cannot be used on them.
+{
+	size_t i = 0;
+	bool negative = false;
+	if (i < word->len && (word->str[i] == '+' || word->str[i] == '-')) {
+		negative = word->str[i] == '-';
+		++i;
+	}
+	// Accumulate towards the sign so LONG_MIN does not overflow
+	long int num = 0;
+	for (; i < word->len && isdigit((unsigned char)word->str[i]); ++i) {
+		int digit = word->str[i] - '0';
+		if (negative) {
+			if (num < (LONG_MIN + digit) / 10) {
+				return (LONG_MIN);
+			}
+			num = num * 10 - digit;
+		} else {
+			if (num > (LONG_MAX - digit) / 10) {
+				return (LONG_MAX);
+			}
+			num = num * 10 + digit;
+		}
+	}
+	return (num);
+}
+
+struct keyed_word {
+	long int key;
+	struct word word;
+};
+
+static long int len_key(const struct word *word)
+{
+	return (word->len);
+}
+
+static long int scrabble_key(const struct word *word)
+{
+	return (scrabble_sort_helper(word));
+}
+
+static long int count_key(const struct word *word)
+{
+	return (word_count(word));
+}
+
+static long int (*key_function(int (*algorithm)(const void *, const void *)))
+ (const struct word *)
+// Returns the function giving the integer key algorithm orders words
+// by, or NULL if algorithm does not order by an integer.
+{
+	if (algorithm == len_sort) {
+		return (len_key);
+	}
+	if (algorithm == num_sort || algorithm == big_num_sort) {
+		return (word_to_long);
+	}
+	if (algorithm == scrabble_sort) {
+		return (scrabble_key);
+	}
+	if (algorithm == count_sort) {
+		return (count_key);
+	}
+	return (NULL);
+}
+
+static bool key_is_exact(int (*algorithm)(const void *, const void *),
+			 long int key)
+// False if words with this key can still differ under algorithm: the
+// keys of big_num_sort saturate, so its words at LONG_MIN or LONG_MAX
+// need comparing in full.
+{
+	return (algorithm != big_num_sort
+		|| (key != LONG_MIN && key != LONG_MAX));
+}
+
+enum radix_sizes {
+	RADIX_BUCKETS = 257,	// One per byte value, plus one for words that
+	// have already ended
+	RADIX_CUTOFF = 32,	// Buckets smaller than this are insertion sorted
+	RADIX_DIGITS = 256	// Values of one byte of an integer key
+};
+
+static void radix_keyed(struct keyed_word *records, struct keyed_word *aux,
+			size_t len)
+// Stable LSD radix sort of records by key, one byte at a time from
+// the least significant, using aux (at least len records long) as
+// scratch space. Every byte's counts are taken in a single pass, and
+// bytes that all keys share are skipped, so small or clustered keys
+// such as lengths and IDs take few passes.
+{
+	if (len < RADIX_CUTOFF) {
+		// Case: Insertion sort is faster on short runs
+		for (size_t i = 1; i < len; ++i) {
+			struct keyed_word tmp = records[i];
+			size_t j = i;
+			for (; j > 0 && records[j - 1].key > tmp.key; --j) {
+				records[j] = records[j - 1];
+			}
+			records[j] = tmp;
+		}
+		return;
+	}
+	// Flipping the sign bit orders the keys as unsigned integers
+	const unsigned long int sign = ~(ULONG_MAX >> 1);
+	size_t counts[sizeof(long int)][RADIX_DIGITS] = { { 0 } };
+	for (size_t i = 0; i < len; ++i) {
+		unsigned long int key = (unsigned long int)records[i].key ^ sign;
+		for (size_t byte = 0; byte < sizeof(key); ++byte) {
+			++counts[byte][(key >> (byte * CHAR_BIT)) & UCHAR_MAX];
+		}
+	}
+	struct keyed_word *src = records;
+	struct keyed_word *dst = aux;
+	for (size_t byte = 0; byte < sizeof(long int); ++byte) {
+		size_t shift = byte * CHAR_BIT;
+		unsigned long int first = (unsigned long int)src[0].key ^ sign;
+		if (counts[byte][(first >> shift) & UCHAR_MAX] == len) {
+			// Case: Every key has this byte in common
 			continue;
 		}
-		int alpha_index = tmp - 'a';
-		if (num_tiles[alpha_index] > 0) {
-			--num_tiles[alpha_index];
+		size_t starts[RADIX_DIGITS];
+		size_t start = 0;
+		for (size_t digit = 0; digit < RADIX_DIGITS; ++digit) {
+			starts[digit] = start;
+			start += counts[byte][digit];
+		}
+		for (size_t i = 0; i < len; ++i) {
+			unsigned long int key =
+			    (unsigned long int)src[i].key ^ sign;
+			dst[starts[(key >> shift) & UCHAR_MAX]++] = src[i];
+		}
+		struct keyed_word *tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+	if (src != records) {
+		memcpy(records, src, len * sizeof(*records));
+	}
+}
+
+static void merge_words(struct word *words, struct word *aux, size_t len,
+			int (*algorithm)(const void *, const void *))
+// Stable merge sort of len words by algorithm, using aux (at least
+// len / 2 words long) as scratch space.
+{
+	if (len < 16) {
+		// Case: Insertion sort is faster on short runs
+		for (size_t i = 1; i < len; ++i) {
+			struct word tmp = words[i];
+			size_t j = i;
+			for (; j > 0 && algorithm(&words[j - 1], &tmp) > 0; --j) {
+				words[j] = words[j - 1];
+			}
+			words[j] = tmp;
+		}
+		return;
+	}
+	size_t half = len / 2;
+	merge_words(words, aux, half, algorithm);
+	merge_words(words + half, aux, len - half, algorithm);
+	if (algorithm(&words[half - 1], &words[half]) <= 0) {
+		// Case: Halves are already in order
+		return;
+	}
+	memcpy(aux, words, half * sizeof(*words));
+	size_t left = 0;
+	size_t right = half;
+	size_t out = 0;
+	while (left < half && right < len) {
+		// Ties take from the left half to keep the sort stable
+		if (algorithm(&words[right], &aux[left]) < 0) {
+			words[out++] = words[right++];
 		} else {
-			continue;
+			words[out++] = aux[left++];
 		}
-		if (strchr("aeilnorstu", tmp)) {
-			score += 1;
-			continue;
+	}
+	while (left < half) {
+		words[out++] = aux[left++];
+	}
+}
+
+static int compare_from(const struct word *word_1, const struct word *word_2,
+			size_t depth, bool fold)
+// Compares two words known to be equal before depth, either as
+// ascii_sort does or, if fold is set, as insensitive_ascii_sort does.
+{
+	size_t len = word_1->len < word_2->len ? word_1->len : word_2->len;
+	int result = 0;
+	if (len > depth) {
+		result = fold ?
+		    fold_compare(word_1->str + depth, word_2->str + depth,
+				 len - depth) :
+		    memcmp(word_1->str + depth, word_2->str + depth, len - depth);
+	}
+	if (result || word_1->len == word_2->len) {
+		return (result);
+	}
+	return (word_1->len > word_2->len ? 1 : -1);
+}
+
+static unsigned short radix_bucket(const struct word *word, size_t depth,
+				   bool fold)
+// Returns the bucket word belongs in when distributing on the byte at
+// depth. Words shorter than depth + 1 go in bucket 0, ahead of all
+// longer words sharing their prefix.
+{
+	if (word->len <= depth) {
+		return (0);
+	}
+	unsigned char chr = word->str[depth];
+	if (fold) {
+		chr = fold_byte(chr);
+	}
+	return (chr + 1);
+}
+
+static size_t common_prefix(const struct word *words, size_t len,
+			    size_t depth, bool fold)
+// Returns the length of the prefix shared by all len words, which are
+// known to be equal before depth.
+{
+	size_t prefix = words[0].len;
+	for (size_t i = 1; i < len && prefix > depth; ++i) {
+		size_t chr = depth;
+		while (chr < prefix && chr < words[i].len
+		       && radix_bucket(&words[0], chr, fold) ==
+		       radix_bucket(&words[i], chr, fold)) {
+			++chr;
 		}
-		if ('d' == tmp || 'g' == tmp) {
-			score += 2;
-			continue;
+		prefix = chr;
+	}
+	return (prefix);
+}
+
+static void radix_sort(struct word *words, struct word *aux,
+		       unsigned short *buckets, size_t len, size_t depth,
+		       bool fold)
+// MSD radix sort of len words that are all equal before depth, using
+// aux and buckets (both at least len long) as scratch space.
+// Distribution is stable, so words that compare equal keep their
+// original order.
+{
+	while (len >= RADIX_CUTOFF) {
+		size_t counts[RADIX_BUCKETS] = { 0 };
+		for (size_t i = 0; i < len; ++i) {
+			buckets[i] = radix_bucket(&words[i], depth, fold);
+			++counts[buckets[i]];
 		}
-		if (strchr("bcmp", tmp)) {
-			score += 3;
-			continue;
+		size_t largest = 0;
+		for (size_t bucket = 1; bucket < RADIX_BUCKETS; ++bucket) {
+			if (counts[bucket] > counts[largest]) {
+				largest = bucket;
+			}
 		}
-		if (strchr("fhvwy", tmp)) {
-			score += 4;
+		if (counts[largest] == len) {
+			// Case: Every word shares this byte, skip past all the
+			// bytes they have in common
+			if (largest == 0) {
+				return;
+			}
+			depth = common_prefix(words, len, depth + 1, fold);
 			continue;
 		}
-		if ('k' == tmp) {
-			score += 5;
-			continue;
+
+		size_t starts[RADIX_BUCKETS];
+		size_t start = 0;
+		for (size_t bucket = 0; bucket < RADIX_BUCKETS; ++bucket) {
+			starts[bucket] = start;
+			start += counts[bucket];
 		}
-		if ('j' == tmp || 'x' == tmp) {
-			score += 8;
-			continue;
+		for (size_t i = 0; i < len; ++i) {
+			aux[starts[buckets[i]]++] = words[i];
+		}
+		memcpy(words, aux, len * sizeof(*words));
+
+		// Recurse into every bucket but the largest, then loop on
+		// it, so the recursion is never deeper than log2(len)
+		start = counts[0];
+		size_t largest_start = 0;
+		for (size_t bucket = 1; bucket < RADIX_BUCKETS; ++bucket) {
+			if (bucket == largest) {
+				largest_start = start;
+			} else if (counts[bucket] > 1) {
+				radix_sort(words + start, aux, buckets,
+					   counts[bucket], depth + 1, fold);
+			}
+			start += counts[bucket];
+		}
+		if (largest == 0) {
+			return;
+		}
+		words += largest_start;
+		len = counts[largest];
+		++depth;
+	}
+
+	for (size_t i = 1; i < len; ++i) {
+		struct word tmp = words[i];
+		size_t j = i;
+		for (; j > 0 && compare_from(&words[j - 1], &tmp, depth, fold) > 0;
+		     --j) {
+			words[j] = words[j - 1];
+		}
+		words[j] = tmp;
+	}
+}
+
+enum length_sizes {
+	LENGTH_MAX_BUCKETS = 1 << 16	// len_sort counting sorts words
+	// shorter than this, and key sorts input with longer ones
+};
+
+static bool count_lengths(struct word *words, size_t len, size_t longest)
+// Stable counting sort of len words, none longer than longest, by
+// length: one pass counts the words of each length and another places
+// them. Returns false if out of memory.
+{
+	size_t *starts = calloc(longest + 1, sizeof(*starts));
+	struct word *aux = malloc(len * sizeof(*aux));
+	if (!starts || !aux) {
+		free(starts);
+		free(aux);
+		return (false);
+	}
+	for (size_t i = 0; i < len; ++i) {
+		++starts[words[i].len];
+	}
+	size_t start = 0;
+	for (size_t length = 0; length <= longest; ++length) {
+		size_t count = starts[length];
+		starts[length] = start;
+		start += count;
+	}
+	for (size_t i = 0; i < len; ++i) {
+		aux[starts[words[i].len]++] = words[i];
+	}
+	memcpy(words, aux, len * sizeof(*words));
+	stats_sample_heap();
+	free(starts);
+	free(aux);
+	return (true);
+}
+
+enum parallel_sizes {
+	PARALLEL_MIN_WORDS = 1 << 15	// Fewest words worth handing to a
+	// thread of their own
+};
+
+struct slice_task {
+	struct word *words;	// Slice to sort, or to take keys from
+	struct word *aux;
+	unsigned short *buckets;
+	struct keyed_word *records;	// Set when sorting on keys
+	struct keyed_word *records_aux;
+	size_t len;
+	int (*algorithm)(const void *, const void *);
+	long int (*key_func)(const struct word *);
+};
+
+struct merge_task {
+	const char *left;
+	size_t left_len;
+	const char *right;
+	size_t right_len;
+	char *out;		// Output of the whole merge
+	size_t out_start;	// Part of out this task produces
+	size_t out_end;
+	size_t size;		// Size of one element
+	int (*compare)(const void *, const void *);
+};
+
+static int keyed_sort(const void *record_1, const void *record_2)
+// Sort two keyed words by key in ascending order.
+{
+	long int key_1 = ((const struct keyed_word *)record_1)->key;
+	long int key_2 = ((const struct keyed_word *)record_2)->key;
+	if (key_1 == key_2) {
+		return (0);
+	}
+	return (key_1 > key_2 ? 1 : -1);
+}
+
+static void *sort_slice(void *arg)
+// Thread body that sorts one slice the same way the serial path of
+// sort_words() would.
+{
+	struct slice_task *task = arg;
+	if (task->records) {
+		for (size_t i = 0; i < task->len; ++i) {
+			task->records[i].key = task->key_func(&task->words[i]);
+			task->records[i].word = task->words[i];
 		}
-		if ('q' == tmp || 'z' == tmp) {
-			score += 10;
+		radix_keyed(task->records, task->records_aux, task->len);
+	} else if (task->algorithm == ascii_sort
+		   || task->algorithm == insensitive_ascii_sort) {
+		radix_sort(task->words, task->aux, task->buckets, task->len, 0,
+			   task->algorithm == insensitive_ascii_sort);
+	} else {
+		qsort(task->words, task->len, sizeof(*task->words),
+		      task->algorithm);
+	}
+	return (NULL);
+}
+
+static size_t co_rank(const struct merge_task *task, size_t rank)
+// Returns how many of the first rank elements of the merged output
+// come from the left run. Ties go to the left run, as in a serial
+// stable merge.
+{
+	size_t low = rank > task->right_len ? rank - task->right_len : 0;
+	size_t high = rank < task->left_len ? rank : task->left_len;
+	while (low < high) {
+		size_t left = low + (high - low) / 2;
+		size_t right = rank - left;
+		if (right > 0 && task->compare(task->left + left * task->size,
+					       task->right + (right - 1) *
+					       task->size) <= 0) {
+			// Case: left element belongs before the right one
+			low = left + 1;
+		} else {
+			high = left;
+		}
+	}
+	return (low);
+}
+
+static void *merge_slice(void *arg)
+// Thread body that produces out_start to out_end of the stable merge
+// of a left and a right run.
+{
+	struct merge_task *task = arg;
+	size_t left = co_rank(task, task->out_start);
+	size_t right = task->out_start - left;
+	size_t left_end = co_rank(task, task->out_end);
+	size_t right_end = task->out_end - left_end;
+	char *out = task->out + task->out_start * task->size;
+	while (left < left_end && right < right_end) {
+		const char *left_elem = task->left + left * task->size;
+		const char *right_elem = task->right + right * task->size;
+		if (task->compare(right_elem, left_elem) < 0) {
+			memcpy(out, right_elem, task->size);
+			++right;
+		} else {
+			memcpy(out, left_elem, task->size);
+			++left;
+		}
+		out += task->size;
+	}
+	memcpy(out, task->left + left * task->size,
+	       (left_end - left) * task->size);
+	out += (left_end - left) * task->size;
+	memcpy(out, task->right + right * task->size,
+	       (right_end - right) * task->size);
+	return (NULL);
+}
+
+static bool run_tasks(void *(*body)(void *), void *tasks, size_t count,
+		      size_t size)
+// Runs body once per task, each on its own thread, and waits for all
+// of them. Returns false if a thread could not be started.
+{
+	pthread_t *ids = malloc(count * sizeof(*ids));
+	if (!ids) {
+		return (false);
+	}
+	bool started = true;
+	size_t i = 0;
+	for (; i < count; ++i) {
+		if (pthread_create(&ids[i], NULL, body,
+				   (char *)tasks + i * size)) {
+			started = false;
+			break;
+		}
+	}
+	for (size_t j = 0; j < i; ++j) {
+		pthread_join(ids[j], NULL);
+	}
+	free(ids);
+	return (started);
+}
+
+static char *merge_runs(char *src, char *dst, size_t len, size_t size,
+			size_t *run_starts, size_t runs, size_t threads,
+			int (*compare)(const void *, const void *))
+// Stably merges the sorted runs of src, whose starts are listed in
+// run_starts (followed by len), in rounds of pairwise merges. Each
+// round splits its merges into segments across threads. Returns
+// whichever of src or dst holds the result, or NULL if out of
+// memory or threads.
+{
+	struct merge_task *tasks =
+	    malloc((threads + runs) * sizeof(*tasks));
+	if (!tasks) {
+		return (NULL);
+	}
+	while (runs > 1) {
+		size_t count = 0;
+		size_t merged = 0;
+		for (size_t run = 0; run < runs; run += 2) {
+			size_t start = run_starts[run];
+			size_t middle = run_starts[run + 1];
+			size_t end = run + 2 <= runs ? run_starts[run + 2] : middle;
+			// Threads in proportion to this merge's share of len
+			size_t segments = threads * (end - start) / len;
+			if (segments == 0) {
+				segments = 1;
+			}
+			for (size_t seg = 0; seg < segments; ++seg) {
+				struct merge_task *task = &tasks[count++];
+				task->left = src + start * size;
+				task->left_len = middle - start;
+				task->right = src + middle * size;
+				task->right_len = end - middle;
+				task->out = dst + start * size;
+				task->out_start = (end - start) * seg / segments;
+				task->out_end =
+				    (end - start) * (seg + 1) / segments;
+				task->size = size;
+				task->compare = compare;
+			}
+			run_starts[merged++] = start;
+		}
+		run_starts[merged] = len;
+		if (!run_tasks(merge_slice, tasks, count, sizeof(*tasks))) {
+			free(tasks);
+			return (NULL);
+		}
+		runs = merged;
+		char *tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+	free(tasks);
+	return (src);
+}
+
+struct collate_task {
+	const struct word *words;	// Slice to compute keys of
+	struct word *keys;	// Each followed in memory by the index of
+	// its word in the whole array
+	size_t start;		// Index of words[0] in the whole array
+	size_t len;
+	bool fold;
+	struct arena *arena;	// Owns the keys
+	bool failed;		// Out of memory, keys is incomplete
+};
+
+static void *collate_slice(void *arg)
+// Thread body that computes the collation keys of one slice.
+{
+	struct collate_task *task = arg;
+	struct utf8_scratch scratch = { NULL, 0, NULL, 0 };
+	for (size_t i = 0; i < task->len; ++i) {
+		size_t key_len;
+		size_t index = task->start + i;
+		if (!utf8_transform(&scratch, task->words[i].str,
+				    task->words[i].len, task->fold,
+				    sizeof(index), &key_len)) {
+			task->failed = true;
+			break;
+		}
+		memcpy(scratch.key + key_len, &index, sizeof(index));
+		char *stored = arena_store(task->arena, scratch.key,
+					   key_len + sizeof(index));
+		if (!stored) {
+			task->failed = true;
+			break;
+		}
+		task->keys[i].str = stored;
+		task->keys[i].len = key_len;
+	}
+	utf8_scratch_free(&scratch);
+	return (NULL);
+}
+
+static bool collate_words(struct word *words, size_t len, bool fold,
+			  size_t threads)
+// Sorts len words stably by the collation of the locale, after
+// utf8_fold() if fold is set. Each word's strxfrm() key is computed
+// once, on threads threads, and the keys are radix sorted as
+// ascii_sort orders them, so the locale is never consulted per
+// comparison. Returns false if out of memory.
+{
+	struct word *keys = malloc(len * sizeof(*keys));
+	struct collate_task *tasks = calloc(threads, sizeof(*tasks));
+	bool success = keys && tasks;
+	for (size_t i = 0; success && i < threads; ++i) {
+		size_t start = len * i / threads;
+		tasks[i].words = words + start;
+		tasks[i].keys = keys + start;
+		tasks[i].start = start;
+		tasks[i].len = len * (i + 1) / threads - start;
+		tasks[i].fold = fold;
+		tasks[i].arena = arena_create();
+		success = tasks[i].arena != NULL;
+	}
+	if (success) {
+		if (threads == 1) {
+			collate_slice(&tasks[0]);
+		} else {
+			success = run_tasks(collate_slice, tasks, threads,
+					    sizeof(*tasks));
+		}
+	}
+	for (size_t i = 0; success && i < threads; ++i) {
+		success = !tasks[i].failed;
+	}
+	success = success && sort_words(keys, len, ascii_sort, threads);
+	struct word *originals = success ? malloc(len * sizeof(*originals))
+	    : NULL;
+	if (originals) {
+		memcpy(originals, words, len * sizeof(*originals));
+		for (size_t i = 0; i < len; ++i) {
+			size_t index;
+			memcpy(&index, keys[i].str + keys[i].len,
+			       sizeof(index));
+			words[i] = originals[index];
+		}
+	} else {
+		success = false;
+	}
+	stats_sample_heap();
+	for (size_t i = 0; tasks && i < threads; ++i) {
+		arena_destroy(tasks[i].arena);
+	}
+	free(originals);
+	free(keys);
+	free(tasks);
+	return (success);
+}
+
+bool sort_words(struct word *words, size_t len,
+		int (*algorithm)(const void *, const void *), size_t threads)
+// Sorts len words in place in ascending order of algorithm, keeping
+// words that compare equal in their original order. ascii_sort and
+// insensitive_ascii_sort use an MSD radix sort that never rescans a
+// shared prefix. len_sort is a counting sort on the recorded lengths
+// unless a word is LENGTH_MAX_BUCKETS bytes or longer. Otherwise
+// algorithms that order words by an integer (len_sort, num_sort,
+// big_num_sort, scrabble_sort, count_sort) have that key computed once
+// per word and are LSD radix sorted on it; big_num_sort then merge
+// sorts the words whose keys saturated. collate_sort and
+// insensitive_collate_sort radix sort a collation key computed once per
+// word. With more than one thread, slices of words are sorted
+// concurrently and then merged in parallel; the result is the same as
+// with one. Returns false if out of memory.
+{
+	if (algorithm == len_sort) {
+		size_t longest = 0;
+		for (size_t i = 0; i < len; ++i) {
+			if (words[i].len > longest) {
+				longest = words[i].len;
+			}
+		}
+		if (longest < LENGTH_MAX_BUCKETS) {
+			// Case: Two linear passes beat any threaded sort
+			return (count_lengths(words, len, longest));
+		}
+	}
+	if (threads > len / PARALLEL_MIN_WORDS) {
+		threads = len / PARALLEL_MIN_WORDS;
+	}
+	if (threads == 0) {
+		threads = 1;
+	}
+	if (is_collation(algorithm)) {
+		return (collate_words(words, len,
+				      algorithm == insensitive_collate_sort,
+				      threads));
+	}
+	long int (*key_func)(const struct word *) = key_function(algorithm);
+
+	struct keyed_word *records = NULL;
+	struct keyed_word *records_aux = NULL;
+	struct word *aux = NULL;
+	unsigned short *buckets = NULL;
+	size_t *run_starts = malloc((threads + 1) * sizeof(*run_starts));
+	struct slice_task *tasks = malloc(threads * sizeof(*tasks));
+	bool success = run_starts && tasks;
+	if (key_func) {
+		records = malloc(len * sizeof(*records));
+		records_aux = malloc(len * sizeof(*records_aux));
+		success = success && records && records_aux;
+	} else {
+		aux = malloc(len * sizeof(*aux));
+		buckets = malloc(len * sizeof(*buckets));
+		success = success && aux && buckets;
+	}
+
+	for (size_t i = 0; success && i < threads; ++i) {
+		size_t start = len * i / threads;
+		run_starts[i] = start;
+		tasks[i].words = words + start;
+		tasks[i].aux = aux ? aux + start : NULL;
+		tasks[i].buckets = buckets ? buckets + start : NULL;
+		tasks[i].records = records ? records + start : NULL;
+		tasks[i].records_aux = records_aux ? records_aux + start : NULL;
+		tasks[i].len = len * (i + 1) / threads - start;
+		tasks[i].algorithm = algorithm;
+		tasks[i].key_func = key_func;
+	}
+	if (success) {
+		run_starts[threads] = len;
+		if (threads == 1) {
+			sort_slice(&tasks[0]);
+		} else {
+			success = run_tasks(sort_slice, tasks, threads,
+					    sizeof(*tasks));
+		}
+	}
+	if (success && key_func) {
+		struct keyed_word *sorted = records;
+		if (threads > 1) {
+			sorted = (struct keyed_word *)
+			    merge_runs((char *)records, (char *)records_aux,
+				       len, sizeof(*records), run_starts,
+				       threads, threads, keyed_sort);
+			success = sorted != NULL;
+		}
+		for (size_t i = 0; success && i < len; ++i) {
+			words[i] = sorted[i].word;
+		}
+		// Runs of keys that do not settle the order are still in
+		// input order, so sorting each stably finishes the job
+		bool exact = algorithm != big_num_sort;
+		for (size_t i = 0; success && !exact && i < len;) {
+			size_t run = i + 1;
+			while (run < len && sorted[run].key == sorted[i].key) {
+				++run;
+			}
+			if (run - i > 1 && !key_is_exact(algorithm, sorted[i].key)) {
+				// records_aux is free again if sorted is records
+				struct word *scratch = sorted == records ?
+				    (struct word *)records_aux :
+				    (struct word *)records;
+				merge_words(words + i, scratch, run - i,
+					    algorithm);
+			}
+			i = run;
+		}
+	} else if (success && threads > 1) {
+		struct word *sorted = (struct word *)
+		    merge_runs((char *)words, (char *)aux, len, sizeof(*words),
+			       run_starts, threads, threads, algorithm);
+		if (!sorted) {
+			success = false;
+		} else if (sorted != words) {
+			memcpy(words, sorted, len * sizeof(*words));
+		}
+	}
+
+	stats_sample_heap();
+	free(run_starts);
+	free(tasks);
+	free(records);
+	free(records_aux);
+	free(aux);
+	free(buckets);
+	return (success);
+}
+
+struct select_item {
+	long int key;		// Only used by algorithms with a key
+	size_t index;		// Position of the word in the input
+};
+
+struct select_heap {
+	const struct word *words;
+	struct select_item *items;
+	size_t len;
+	int (*algorithm)(const void *, const void *);
+	long int (*key_func)(const struct word *);
+	bool keep_largest;	// Min-heap of the largest words if set,
+	// else max-heap of the smallest
+};
+
+static bool item_less(const struct select_heap *heap,
+		      const struct select_item *item_1,
+		      const struct select_item *item_2)
+// Orders two items as a stable sort would: by algorithm, then by
+// input position.
+{
+	int result;
+	if (heap->key_func && (item_1->key != item_2->key
+			       || key_is_exact(heap->algorithm, item_1->key))) {
+		result = (item_1->key > item_2->key) - (item_1->key < item_2->key);
+	} else {
+		result = heap->algorithm(&heap->words[item_1->index],
+					 &heap->words[item_2->index]);
+	}
+	if (result) {
+		return (result < 0);
+	}
+	return (item_1->index < item_2->index);
+}
+
+static bool item_above(const struct select_heap *heap,
+		       const struct select_item *item_1,
+		       const struct select_item *item_2)
+// True if item_1 belongs nearer the top of heap than item_2.
+{
+	if (heap->keep_largest) {
+		return (item_less(heap, item_1, item_2));
+	}
+	return (item_less(heap, item_2, item_1));
+}
+
+static void select_sift_down(struct select_heap *heap, size_t pos)
+{
+	for (;;) {
+		size_t top = pos;
+		size_t left = 2 * pos + 1;
+		size_t right = left + 1;
+		if (left < heap->len
+		    && item_above(heap, &heap->items[left], &heap->items[top])) {
+			top = left;
+		}
+		if (right < heap->len
+		    && item_above(heap, &heap->items[right],
+				  &heap->items[top])) {
+			top = right;
+		}
+		if (top == pos) {
+			return;
+		}
+		struct select_item tmp = heap->items[pos];
+		heap->items[pos] = heap->items[top];
+		heap->items[top] = tmp;
+		pos = top;
+	}
+}
+
+bool select_words(struct word *words, size_t len, size_t start, size_t end,
+		  int (*algorithm)(const void *, const void *))
+// Moves the words that a stable sort by algorithm would place at
+// start to end into words[0] to words[end - start - 1], in sorted
+// order, without sorting the rest. Keeps a bounded heap of whichever
+// of the first end or the last len - start words is smaller, so the
+// cost is O(len log k) for a window reaching k words into either end.
+// Returns false if out of memory.
+{
+	struct select_heap heap;
+	heap.words = words;
+	heap.len = 0;
+	heap.algorithm = algorithm;
+	heap.key_func = key_function(algorithm);
+	heap.keep_largest = len - start < end;
+	size_t keep = heap.keep_largest ? len - start : end;
+	if (keep == 0) {
+		return (true);
+	}
+	heap.items = malloc(keep * sizeof(*heap.items));
+	struct word *window = malloc((end - start) * sizeof(*window));
+	if (!heap.items || !window) {
+		free(heap.items);
+		free(window);
+		return (false);
+	}
+
+	for (size_t i = 0; i < len; ++i) {
+		struct select_item item = { 0, i };
+		if (heap.key_func) {
+			item.key = heap.key_func(&words[i]);
+		}
+		if (heap.len < keep) {
+			// Case: Heap still filling, sift the new item up
+			size_t pos = heap.len++;
+			while (pos > 0 && item_above(&heap, &item,
+						     &heap.items[(pos - 1) / 2])) {
+				heap.items[pos] = heap.items[(pos - 1) / 2];
+				pos = (pos - 1) / 2;
+			}
+			heap.items[pos] = item;
+		} else if (item_above(&heap, &heap.items[0], &item)) {
+			// Case: Item displaces the worst one kept
+			heap.items[0] = item;
+			select_sift_down(&heap, 0);
+		}
+	}
+
+	// Popping the top to the back leaves the items ordered from the
+	// bottom of the heap up: ascending for a max-heap, else descending
+	while (heap.len > 1) {
+		struct select_item tmp = heap.items[0];
+		heap.items[0] = heap.items[--heap.len];
+		heap.items[heap.len] = tmp;
+		select_sift_down(&heap, 0);
+	}
+	for (size_t i = 0; i < end - start; ++i) {
+		size_t pos = heap.keep_largest ? keep - 1 - i : start + i;
+		window[i] = words[heap.items[pos].index];
+	}
+	memcpy(words, window, (end - start) * sizeof(*words));
+	stats_sample_heap();
+	free(heap.items);
+	free(window);
+	return (true);
+}
+
+static bool run_beats(const struct run_merge *merge, size_t run_1,
+		      size_t run_2)
+// True if the next word of run_1 comes out of the merge before that of
+// run_2. Exhausted runs lose to everything and ties go to the earlier
+// run, which keeps the merge stable.
+{
+	if (merge->heads[run_1] == merge->ends[run_1]) {
+		return (false);
+	}
+	if (merge->heads[run_2] == merge->ends[run_2]) {
+		return (true);
+	}
+	int result = merge->algorithm(merge->heads[run_1], merge->heads[run_2]);
+	return (result < 0 || (result == 0 && run_1 < run_2));
+}
+
+static size_t build_tree(struct run_merge *merge, size_t node)
+// Plays off the runs below node, recording the loser at each internal
+// node, and returns the winner. Leaf i sits at node runs + i.
+{
+	if (node >= merge->runs) {
+		return (node - merge->runs);
+	}
+	size_t left = build_tree(merge, 2 * node);
+	size_t right = build_tree(merge, 2 * node + 1);
+	if (run_beats(merge, left, right)) {
+		merge->tree[node] = right;
+		return (left);
+	}
+	merge->tree[node] = left;
+	return (right);
+}
+
+bool run_merge_init(struct run_merge *merge, struct word *const *runs,
+		    const size_t *lens, size_t count,
+		    int (*algorithm)(const void *, const void *))
+// Prepares merge to combine the count runs, each of lens[i] words
+// already sorted by algorithm, into one sorted sequence. The runs must
+// outlive the merge. Returns false if out of memory.
+{
+	merge->algorithm = algorithm;
+	merge->runs = count;
+	merge->heads = malloc((count ? count : 1) * sizeof(*merge->heads));
+	merge->ends = malloc((count ? count : 1) * sizeof(*merge->ends));
+	merge->tree = malloc((count ? count : 1) * sizeof(*merge->tree));
+	if (!merge->heads || !merge->ends || !merge->tree) {
+		run_merge_free(merge);
+		return (false);
+	}
+	for (size_t i = 0; i < count; ++i) {
+		merge->heads[i] = runs[i];
+		merge->ends[i] = runs[i] + lens[i];
+	}
+	merge->tree[0] = count ? build_tree(merge, 1) : 0;
+	return (true);
+}
+
+bool run_merge_next(struct run_merge *merge, struct word *word)
+// Stores the next word of the merged sequence in word. Returns false
+// once every run is exhausted. Each word costs one comparison per
+// level of the tree, replayed from the winner's leaf to the root.
+{
+	size_t winner = merge->tree[0];
+	if (!merge->runs || merge->heads[winner] == merge->ends[winner]) {
+		return (false);
+	}
+	*word = *merge->heads[winner];
+	++merge->heads[winner];
+	for (size_t node = (winner + merge->runs) / 2; node > 0; node /= 2) {
+		if (run_beats(merge, merge->tree[node], winner)) {
+			size_t tmp = merge->tree[node];
+			merge->tree[node] = winner;
+			winner = tmp;
+		}
+	}
+	merge->tree[0] = winner;
+	return (true);
+}
+
+void run_merge_free(struct run_merge *merge)
+// Releases the memory held by merge, but not the runs it merged.
+{
+	free(merge->heads);
+	free(merge->ends);
+	free(merge->tree);
+	merge->heads = NULL;
+	merge->ends = NULL;
+	merge->tree = NULL;
+}
+
+bool is_collation(int (*algorithm)(const void *, const void *))
+// True if algorithm orders words by the collation of the locale.
+{
+	return (algorithm == collate_sort
+		|| algorithm == insensitive_collate_sort);
+}
+
+bool equates_duplicates(int (*algorithm)(const void *, const void *),
+			bool case_insensitive)
+// True if words that are duplicates for the -u option always compare
+// equal under algorithm, so that a sorted array or stream only needs
+// each run of equal words searched for them. Folding by code point in
+// UTF-8 mode can change a word's length in bytes and which ASCII
+// letters it holds, so duplicates can land in different runs of
+// len_sort and scrabble_sort.
+{
+	return (!case_insensitive || !utf8_enabled()
+		|| (algorithm != len_sort && algorithm != scrabble_sort));
+}
+
+bool groups_duplicates(int (*algorithm)(const void *, const void *),
+		       bool case_insensitive)
+// True if words that compare equal under algorithm are always
+// duplicates of each other for the given case sensitivity.
+{
+	return ((algorithm == ascii_sort && !case_insensitive)
+		|| (algorithm == insensitive_ascii_sort && case_insensitive));
+}
+
+bool filter_words(struct word *words, size_t *len, bool scrabble,
+		  bool unique, int (*algorithm)(const void *, const void *),
+		  bool case_insensitive)
+// Removes Scrabble-invalid words if scrabble is set and duplicate words
+// for the purposes of the -u option if unique is set, in one pass that
+// moves the surviving views of the *len words towards the front of the
+// array and updates *len. The word bytes are not touched. For unique the
+// array must already be sorted by algorithm, or algorithm be NULL; the
+// first of each set of duplicates is kept. Where duplicates always
+// compare equal (equates_duplicates()), in a sorted array only each run
+// of equal words needs checking: when algorithm only equates duplicates
+// every word after the first of a run is pruned, otherwise the run's
+// distinct words are tracked in a hash set. With a NULL algorithm, or
+// one that can split duplicates between runs, every distinct word is
+// tracked, and the words may be in any order. Returns false if out of
+// memory.
+{
+	bool runs = algorithm && equates_duplicates(algorithm,
+						    case_insensitive);
+	bool grouped = runs && groups_duplicates(algorithm, case_insensitive);
+	struct word_set seen;
+	word_set_init(&seen, case_insensitive);
+	struct word run_first = { NULL, 0 };	// Copied, as its slot may be
+	// overwritten by a later survivor
+	size_t kept = 0;
+	for (size_t word = 0; word < *len; ++word) {
+		struct word current = words[word];
+		if (scrabble && !is_scrabble_word(&current)) {
+			// Invalid words are skipped before looking for
+			// duplicates, so the first valid one is kept, as
+			// when -S runs as a pass of its own
 			continue;
 		}
+		if (unique && runs) {
+			bool new_run = !run_first.str
+			    || algorithm(&run_first, &current) != 0;
+			if (new_run) {
+				// Case: A new run of equal words begins
+				run_first = current;
+				if (!grouped) {
+					word_set_clear(&seen);
+				}
+			} else if (grouped) {
+				continue;
+			}
+		}
+		if (unique && !grouped) {
+			bool added;
+			if (!word_set_insert(&seen, &current, &added)) {
+				word_set_free(&seen);
+				return (false);
+			}
+			if (!added) {
+				continue;
+			}
+		}
+		words[kept] = current;
+		++kept;
 	}
-	return (score);
+	word_set_free(&seen);
+	*len = kept;
+	return (true);
+}
+
+bool is_scrabble_word(const struct word *word)
+// Returns true if word can be spelled with one set of Scrabble tiles,
+// blanks included.
+{
+	bool valid;
+	scrabble_score(word->str, word->len, &valid);
+	return (valid);
 }
@@ -5,17 +5,90 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+
+struct word {
+	const char *str;	// Not NUL-terminated
+	size_t len;
+};
+
+static inline unsigned char fold_byte(unsigned char chr)
+// Lowercases chr as tolower() does in the C locale, which -i folds by,
+// without a call or a locale lookup.
+{
+	return ((unsigned char)(chr - 'A') < 26 ? chr + ('a' - 'A') : chr);
+}
+
+static inline size_t word_count(const struct word *word)
+// Returns the occurrences of a word interned by --count, which are kept
+// in the sizeof(size_t) bytes just before its first byte.
+{
+	size_t count;
+	memcpy(&count, word->str - sizeof(count), sizeof(count));
+	return (count);
+}
+
+// Every comparison function below is passed two pointers to
+// struct word, as qsort() does with an array of them.
 
 int ascii_sort(const void *str_1, const void *str_2);
 
 int insensitive_ascii_sort(const void *str_1, const void *str_2);
 
+int collate_sort(const void *str_1, const void *str_2);
+
+int insensitive_collate_sort(const void *str_1, const void *str_2);
+
 int len_sort(const void *str_1, const void *str_2);
 
 int num_sort(const void *str_1, const void *str_2);
 
+int big_num_sort(const void *str_1, const void *str_2);
+
 int scrabble_sort(const void *str_1, const void *str_2);
 
+int count_sort(const void *str_1, const void *str_2);
+
 int scrabble_sort_helper(const void *str);
 
+long int word_to_long(const struct word *word);
+
+bool is_scrabble_word(const struct word *word);
+
+bool is_collation(int (*algorithm)(const void *, const void *));
+
+bool equates_duplicates(int (*algorithm)(const void *, const void *),
+			bool case_insensitive);
+
+bool groups_duplicates(int (*algorithm)(const void *, const void *),
+		       bool case_insensitive);
+
+bool filter_words(struct word *words, size_t *len, bool scrabble,
+		  bool unique, int (*algorithm)(const void *, const void *),
+		  bool case_insensitive);
+
+bool sort_words(struct word *words, size_t len,
+		int (*algorithm)(const void *, const void *), size_t threads);
+
+bool select_words(struct word *words, size_t len, size_t start, size_t end,
+		  int (*algorithm)(const void *, const void *));
+
+struct run_merge {
+	int (*algorithm)(const void *, const void *);
+	const struct word **heads;	// Next word of each run
+	const struct word **ends;	// One past the last word of each run
+	size_t runs;
+	size_t *tree;		// Loser tree over the runs: tree[0] is the
+	// run holding the smallest word, tree[1] to tree[runs - 1] the
+	// runs that lost at each internal node
+};
+
+bool run_merge_init(struct run_merge *merge, struct word *const *runs,
+		    const size_t *lens, size_t count,
+		    int (*algorithm)(const void *, const void *));
+
+bool run_merge_next(struct run_merge *merge, struct word *word);
+
+void run_merge_free(struct run_merge *merge);
+
 #endif
@@ -0,0 +1,112 @@
+#include <malloc.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "sort.h"
+#include "stats.h"
+
+struct stats stats;
+
+static const char *const phase_names[STATS_PHASES] = {
+	"load", "sort", "filter", "merge", "output"
+};
+
+static double clock_seconds(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+void stats_begin(enum stats_phase phase)
+// Starts timing phase. Phases may nest, each is timed on its own.
+{
+	if (!stats.format) {
+		return;
+	}
+	stats.wall_start[phase] = clock_seconds(CLOCK_MONOTONIC);
+	stats.cpu_start[phase] = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+void stats_end(enum stats_phase phase)
+// Adds the time since stats_begin(phase) to phase and samples the heap.
+{
+	if (!stats.format) {
+		return;
+	}
+	stats.wall[phase] +=
+	    clock_seconds(CLOCK_MONOTONIC) - stats.wall_start[phase];
+	stats.cpu[phase] +=
+	    clock_seconds(CLOCK_PROCESS_CPUTIME_ID) - stats.cpu_start[phase];
+	stats_sample_heap();
+}
+
+void stats_sample_heap(void)
+// Raises the peak heap to the bytes malloc() has handed out now, if
+// more. Called at each phase end and wherever the sorts, filters and
+// loaders hold the most scratch memory, just before freeing it, as
+// scratch freed within a phase is gone by its end. Safe on several
+// threads at once.
+{
+	if (!stats.format) {
+		return;
+	}
+#pragma GCC diagnostic push	// mallinfo2() can only return a struct
+#pragma GCC diagnostic ignored "-Waggregate-return"
+	struct mallinfo2 info = mallinfo2();
+#pragma GCC diagnostic pop
+	size_t heap = info.uordblks + info.hblkhd;
+	size_t peak = __atomic_load_n(&stats.peak_heap, __ATOMIC_RELAXED);
+	while (heap > peak
+	       && !__atomic_compare_exchange_n(&stats.peak_heap, &peak, heap,
+					       true, __ATOMIC_RELAXED,
+					       __ATOMIC_RELAXED)) {
+		// Case: Another thread raised it first, peak now holds its value
+	}
+}
+
+void stats_add_words(const void *words, size_t len)
+// Counts the len struct words at words as loaded.
+{
+	if (!stats.format) {
+		return;
+	}
+	const struct word *word = words;
+	stats.words += len;
+	for (size_t i = 0; i < len; ++i) {
+		stats.bytes += word[i].len;
+	}
+}
+
+void stats_report(void)
+// Prints everything gathered to standard error in the chosen format.
+// Registered with atexit(), so it runs however ws exits.
+{
+	struct rusage usage;
+	long peak_rss = getrusage(RUSAGE_SELF, &usage) ? 0 : usage.ru_maxrss;
+	if (stats.format == STATS_JSON) {
+		fprintf(stderr, "{\"phases\": {");
+		for (size_t i = 0; i < STATS_PHASES; ++i) {
+			fprintf(stderr, "%s\"%s\": {\"wall\": %.6f, \"cpu\": %.6f}",
+				i ? ", " : "", phase_names[i], stats.wall[i],
+				stats.cpu[i]);
+		}
+		fprintf(stderr, "}, \"comparisons\": %llu, \"words\": %zu, "
+			"\"bytes\": %zu, \"prune_passes\": %zu, "
+			"\"peak_heap_bytes\": %zu, \"peak_rss_kib\": %ld}\n",
+			stats.comparisons, stats.words, stats.bytes,
+			stats.prune_passes, stats.peak_heap, peak_rss);
+		return;
+	}
+	fprintf(stderr, "%-12s %12s %12s\n", "phase", "wall (s)", "cpu (s)");
+	for (size_t i = 0; i < STATS_PHASES; ++i) {
+		fprintf(stderr, "%-12s %12.6f %12.6f\n", phase_names[i],
+			stats.wall[i], stats.cpu[i]);
+	}
+	fprintf(stderr, "%-12s %12zu\n", "words", stats.words);
+	fprintf(stderr, "%-12s %12zu\n", "bytes", stats.bytes);
+	fprintf(stderr, "%-12s %12llu\n", "comparisons", stats.comparisons);
+	fprintf(stderr, "%-12s %12zu\n", "prune passes", stats.prune_passes);
+	fprintf(stderr, "%-12s %12zu bytes\n", "peak heap", stats.peak_heap);
+	fprintf(stderr, "%-12s %12ld KiB\n", "peak RSS", peak_rss);
+}
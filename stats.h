@@ -0,0 +1,56 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+enum stats_phase {
+	STATS_LOAD,
+	STATS_SORT,
+	STATS_FILTER,
+	STATS_MERGE,
+	STATS_OUTPUT,
+	STATS_PHASES		// Number of phases
+};
+
+enum stats_format {
+	STATS_OFF,
+	STATS_HUMAN,
+	STATS_JSON
+};
+
+struct stats {
+	enum stats_format format;	// Every hook does nothing if off
+	double wall[STATS_PHASES];	// Seconds spent in each phase
+	double cpu[STATS_PHASES];	// CPU seconds of every thread
+	double wall_start[STATS_PHASES];
+	double cpu_start[STATS_PHASES];
+	unsigned long long comparisons;	// Calls to the comparators
+	size_t words;
+	size_t bytes;		// Sum of the lengths of the words
+	size_t prune_passes;	// Passes compacting the word array
+	size_t peak_heap;	// Most heap bytes in use at any sample
+};
+
+extern struct stats stats;
+
+static inline void stats_count_comparison(void)
+// Counts one comparator call. Comparators run on several threads at
+// once with -j, hence the atomic add.
+{
+	if (stats.format) {
+		__atomic_fetch_add(&stats.comparisons, 1, __ATOMIC_RELAXED);
+	}
+}
+
+void stats_begin(enum stats_phase phase);
+
+void stats_end(enum stats_phase phase);
+
+void stats_sample_heap(void);
+
+void stats_add_words(const void *words, size_t len);
+
+void stats_report(void);
+
+#endif
@@ -0,0 +1,95 @@
+#!/bin/sh
+# Regression tests for ws, run by "make check" from the top of the tree.
+# Each test compares the output of ws against a run known to be right,
+# usually ws itself on the same input by another path.
+
+ws=${WS:-./ws}
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+failures=0
+
+fail()
+# Reports the test named $1 as failed.
+{
+	echo "FAIL: $1"
+	failures=$((failures + 1))
+}
+
+same()
+# Fails the test named $1 unless files $2 and $3 are identical.
+{
+	cmp -s "$2" "$3" || fail "$1"
+}
+
+awk 'BEGIN {
+	srand(1)
+	for (i = 0; i < 40000; ++i) {
+		printf "w%d%s", int(rand() * 100000), i % 8 == 7 ? "\n" : " "
+	}
+}' > "$tmp/words"
+"$ws" "$tmp/words" > "$tmp/sorted"
+"$ws" -u -r "$tmp/words" > "$tmp/unique"
+
+# Case: --memory-limit far below the input spills many runs, which must
+# not each hold a descriptor
+(
+	ulimit -n 32
+	cat "$tmp/words" | "$ws" --memory-limit 512K > "$tmp/out"
+) && same "memory limit, piped" "$tmp/sorted" "$tmp/out" \
+	|| fail "memory limit, piped"
+(
+	ulimit -n 32
+	cat "$tmp/words" | "$ws" --memory-limit 1 -u -r > "$tmp/out"
+) && same "memory limit of 1 byte, piped" "$tmp/unique" "$tmp/out" \
+	|| fail "memory limit of 1 byte, piped"
+(
+	ulimit -n 32
+	"$ws" --memory-limit 1K "$tmp/words" > "$tmp/out"
+) && same "memory limit, mapped" "$tmp/sorted" "$tmp/out" \
+	|| fail "memory limit, mapped"
+
+# Case: Files of /proc have content though their size is 0
+if [ -r /proc/version ]; then
+	cat /proc/version | "$ws" > "$tmp/expected"
+	"$ws" /proc/version > "$tmp/out" \
+		&& same "/proc file" "$tmp/expected" "$tmp/out" \
+		|| fail "/proc file"
+	"$ws" < /proc/version > "$tmp/out" \
+		&& same "/proc file on stdin" "$tmp/expected" "$tmp/out" \
+		|| fail "/proc file on stdin"
+	"$ws" -j 2 /proc/version /proc/version > "$tmp/out" \
+		&& "$ws" -m "$tmp/expected" "$tmp/expected" > "$tmp/twice" \
+		&& same "/proc files in parallel" "$tmp/twice" "$tmp/out" \
+		|| fail "/proc files in parallel"
+	[ -s "$tmp/expected" ] || fail "/proc file read as empty"
+fi
+
+# Case: An index answers as a full run would, for every sort it can
+# hold, and counted output is refused
+for sort in "" -i -l -n --bignum -s "-s -S" "-l -i" --utf8 "--utf8 -i"; do
+	"$ws" $sort --build-index "$tmp/index" "$tmp/words" \
+		&& "$ws" $sort -u -c 50 -C 20 "$tmp/words" > "$tmp/expected" \
+		&& "$ws" $sort -u -c 50 -C 20 --index "$tmp/index" \
+			> "$tmp/out" \
+		&& same "index $sort" "$tmp/expected" "$tmp/out" \
+		|| fail "index $sort"
+done
+for count in --count --frequency; do
+	if "$ws" $count --build-index "$tmp/index" "$tmp/words" \
+		2> /dev/null; then
+		fail "index $count refused"
+	fi
+done
+
+# Case: --count lines read the same backwards under -r
+"$ws" --count "$tmp/words" | awk '{ line[NR] = $0 }
+	END { for (i = NR; i > 0; --i) print line[i] }' > "$tmp/expected"
+"$ws" --count -r "$tmp/words" > "$tmp/out" \
+	&& same "count reversed" "$tmp/expected" "$tmp/out" \
+	|| fail "count reversed"
+
+if [ "$failures" -ne 0 ]; then
+	echo "$failures failed"
+	exit 1
+fi
+echo "All tests passed"
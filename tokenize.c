@@ -0,0 +1,157 @@
+#include <stdint.h>
+#include <string.h>
+#include "tokenize.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// A classifier fills ws with one bit per whitespace byte of the
+// TOKENIZE_BLOCK bytes at buf, the lowest bit for buf[0], and nul with
+// one bit per NUL byte. Whitespace is the set " \t\n\v\f\r".
+#ifdef __SSE2__
+static void classify_sse2(const char *buf, uint64_t *ws, uint64_t *nul)
+{
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i span = _mm_set1_epi8('\r' - '\t');
+	const __m128i zero = _mm_setzero_si128();
+	*ws = 0;
+	*nul = 0;
+	for (size_t i = 0; i < TOKENIZE_BLOCK; i += 16) {
+		__m128i bytes = _mm_loadu_si128((const __m128i *)(buf + i));
+		// \t to \r are the bytes whose distance above \t is at
+		// most span when taken as unsigned
+		__m128i off = _mm_sub_epi8(bytes, tab);
+		__m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(off, span), off);
+		__m128i is_ws = _mm_or_si128(ctl,
+					     _mm_cmpeq_epi8(bytes, space));
+		*ws |= (uint64_t)(uint16_t)_mm_movemask_epi8(is_ws) << i;
+		*nul |= (uint64_t)(uint16_t)
+		    _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero)) << i;
+	}
+}
+
+__attribute__((target("avx2")))
+static void classify_avx2(const char *buf, uint64_t *ws, uint64_t *nul)
+{
+	const __m256i space = _mm256_set1_epi8(' ');
+	const __m256i tab = _mm256_set1_epi8('\t');
+	const __m256i span = _mm256_set1_epi8('\r' - '\t');
+	const __m256i zero = _mm256_setzero_si256();
+	*ws = 0;
+	*nul = 0;
+	for (size_t i = 0; i < TOKENIZE_BLOCK; i += 32) {
+		__m256i bytes = _mm256_loadu_si256((const __m256i *)(buf + i));
+		__m256i off = _mm256_sub_epi8(bytes, tab);
+		__m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(off, span),
+						off);
+		__m256i is_ws = _mm256_or_si256(ctl,
+						_mm256_cmpeq_epi8(bytes,
+								  space));
+		*ws |= (uint64_t)(uint32_t)_mm256_movemask_epi8(is_ws) << i;
+		*nul |= (uint64_t)(uint32_t)
+		    _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, zero)) << i;
+	}
+}
+#else
+static void classify_scalar(const char *buf, uint64_t *ws, uint64_t *nul)
+{
+	*ws = 0;
+	*nul = 0;
+	for (size_t i = 0; i < TOKENIZE_BLOCK; ++i) {
+		unsigned char chr = buf[i];
+		if (chr == ' ' || (chr >= '\t' && chr <= '\r')) {
+			*ws |= (uint64_t)1 << i;
+		} else if (chr == '\0') {
+			*nul |= (uint64_t)1 << i;
+		}
+	}
+}
+#endif
+
+static void (*pick_classifier(void))(const char *, uint64_t *, uint64_t *)
+// Returns the fastest classifier the running CPU supports.
+{
+#ifdef __SSE2__
+	if (__builtin_cpu_supports("avx2")) {
+		return (classify_avx2);
+	}
+	return (classify_sse2);
+#else
+	return (classify_scalar);
+#endif
+}
+
+size_t tokenize(const char *buf, size_t len, bool final,
+		void (*emit)(void *, const char *, size_t), void *ctx)
+// Splits len bytes of buf into words separated by whitespace, passing
+// each to emit along with ctx. A NUL byte drops the rest of its line,
+// as strtok() on a line would. Unless final is set, buf is taken to
+// continue past len, so a word or dropped line still open at the end
+// is left alone. Returns the number of bytes dealt with; the rest
+// must be passed again with more input.
+{
+	void (*classify)(const char *, uint64_t *, uint64_t *) =
+	    pick_classifier();
+	char tail[TOKENIZE_BLOCK];
+	size_t pos = 0;		// Offset of the block being classified
+	size_t start = 0;	// Offset of the word being read
+	bool in_word = false;
+	while (pos < len) {
+		const char *block = buf + pos;
+		size_t block_len = len - pos;
+		if (block_len < TOKENIZE_BLOCK) {
+			// Case: Short final block, pad with whitespace
+			memset(tail, ' ', sizeof(tail));
+			memcpy(tail, block, block_len);
+			block = tail;
+		} else {
+			block_len = TOKENIZE_BLOCK;
+		}
+		uint64_t ws;
+		uint64_t nul;
+		classify(block, &ws, &nul);
+		size_t next = pos + block_len;
+		size_t bit = 0;
+		while (bit < TOKENIZE_BLOCK) {
+			uint64_t rest = ~(uint64_t)0 << bit;
+			uint64_t found = (in_word ? ws | nul : ~ws) & rest;
+			if (!found) {
+				break;
+			}
+			bit = __builtin_ctzll(found);
+			if (in_word && pos + bit < len) {
+				emit(ctx, buf + start, pos + bit - start);
+				in_word = false;
+			} else if (in_word) {
+				// Case: Word ends at the padding
+				break;
+			}
+			if (nul >> bit & 1) {
+				// Case: Rest of the line is invisible to strtok
+				const char *newline = memchr(buf + pos + bit, '\n',
+							     len - pos - bit);
+				if (!newline && !final) {
+					return (pos + bit);
+				}
+				next = newline ? (size_t)(newline - buf) : len;
+				break;
+			}
+			if (!(ws >> bit & 1)) {
+				// Case: A word begins
+				start = pos + bit;
+				in_word = true;
+			}
+			++bit;
+		}
+		pos = next;
+	}
+	if (in_word) {
+		if (!final) {
+			return (start);
+		}
+		emit(ctx, buf + start, len - start);
+	}
+	return (len);
+}
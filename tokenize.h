@@ -0,0 +1,14 @@
+#ifndef TOKENIZE_H
+#define TOKENIZE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+enum tokenize_sizes {
+	TOKENIZE_BLOCK = 64	// Bytes classified at once, one bit each
+};
+
+size_t tokenize(const char *buf, size_t len, bool final,
+		void (*emit)(void *, const char *, size_t), void *ctx);
+
+#endif
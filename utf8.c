@@ -0,0 +1,645 @@
+#include <langinfo.h>
+#include <locale.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wctype.h>
+#include "sort.h"
+#include "utf8.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+static bool enabled;
+
+bool utf8_start(void)
+// Switches ws to UTF-8 mode: takes character classes and collation from
+// the environment's locale, as sort(1) does. If the environment does
+// not name a UTF-8 locale, both come from C.UTF-8 instead, as the
+// locale's collation could not be trusted with UTF-8 text. Returns
+// false if no UTF-8 locale is available.
+{
+	const char *ctype = setlocale(LC_CTYPE, "");
+	if (ctype && !strcmp(nl_langinfo(CODESET), "UTF-8")) {
+		if (!setlocale(LC_COLLATE, "")) {
+			setlocale(LC_COLLATE, "C");
+		}
+	} else if (setlocale(LC_CTYPE, "C.UTF-8")) {
+		setlocale(LC_COLLATE, "C.UTF-8");
+	} else {
+		return (false);
+	}
+	enabled = true;
+	return (true);
+}
+
+bool utf8_enabled(void)
+// True once utf8_start() has succeeded.
+{
+	return (enabled);
+}
+
+static size_t ascii_prefix(const unsigned char *bytes, size_t len)
+// Returns how many of the len bytes at bytes are ASCII before the
+// first that is not, testing 16 bytes at once where SSE2 is available
+// and 8 otherwise.
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	for (; i + 16 <= len; i += 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i *)(bytes + i));
+		int high = _mm_movemask_epi8(chunk);
+		if (high) {
+			return (i + __builtin_ctz(high));
+		}
+	}
+#else
+	for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+		uint64_t chunk;
+		memcpy(&chunk, bytes + i, sizeof(chunk));
+		if (chunk & 0x8080808080808080ULL) {
+			break;
+		}
+	}
+#endif
+	while (i < len && bytes[i] < 0x80) {
+		++i;
+	}
+	return (i);
+}
+
+static size_t sequence_length(const unsigned char *bytes, size_t len)
+// Returns the length of the UTF-8 sequence that starts the len bytes at
+// bytes, or 0 if it is not valid: truncated, overlong, a surrogate or
+// past U+10FFFF.
+{
+	unsigned char lead = bytes[0];
+	unsigned char low = 0x80;	// Range of the second byte
+	unsigned char high = 0xBF;
+	size_t size;
+	if (lead < 0x80) {
+		return (1);
+	} else if (lead >= 0xC2 && lead <= 0xDF) {
+		size = 2;
+	} else if (lead >= 0xE0 && lead <= 0xEF) {
+		size = 3;
+		if (lead == 0xE0) {
+			low = 0xA0;
+		} else if (lead == 0xED) {
+			high = 0x9F;
+		}
+	} else if (lead >= 0xF0 && lead <= 0xF4) {
+		size = 4;
+		if (lead == 0xF0) {
+			low = 0x90;
+		} else if (lead == 0xF4) {
+			high = 0x8F;
+		}
+	} else {
+		return (0);
+	}
+	if (len < size || bytes[1] < low || bytes[1] > high) {
+		return (0);
+	}
+	for (size_t i = 2; i < size; ++i) {
+		if ((bytes[i] & 0xC0) != 0x80) {
+			return (0);
+		}
+	}
+	return (size);
+}
+
+static bool is_space(uint32_t code)
+// True for the characters past ASCII with the Unicode White_Space
+// property.
+{
+	switch (code) {
+	case 0x85:
+	case 0xA0:
+	case 0x1680:
+	case 0x2028:
+	case 0x2029:
+	case 0x202F:
+	case 0x205F:
+	case 0x3000:
+		return (true);
+	default:
+		return (code >= 0x2000 && code <= 0x200A);
+	}
+}
+
+static size_t sequence_size(unsigned char lead)
+// Returns how many bytes the sequence that lead starts should take,
+// going by its high bits alone, or 1 if it cannot start a longer one.
+{
+	if (lead >= 0xF0) {
+		return (lead < 0xF8 ? 4 : 1);
+	}
+	if (lead >= 0xE0) {
+		return (3);
+	}
+	return (lead >= 0xC0 ? 2 : 1);
+}
+
+static bool valid_scalar(const unsigned char *bytes, size_t len,
+			 bool *spaces)
+// True if the len bytes at bytes are valid UTF-8, skipping runs of
+// ASCII in bulk and checking the rest a sequence at a time. Sets
+// *spaces if they hold whitespace past ASCII.
+{
+	size_t i = 0;
+	while (i < len) {
+		i += ascii_prefix(bytes + i, len - i);
+		if (i == len) {
+			break;
+		}
+		size_t size = sequence_length(bytes + i, len - i);
+		if (!size) {
+			return (false);
+		}
+		if (!*spaces) {
+			size_t next = i;
+			*spaces = is_space(utf8_next((const char *)bytes, len,
+						     &next));
+		}
+		i += size;
+	}
+	return (true);
+}
+
+#ifdef __SSE2__
+// Error bits of the lookup tables of valid_avx2(). Each names a way
+// a pair of bytes can break UTF-8; the tables of a pair's first byte's
+// high and low nibbles and its second byte's high nibble each hold the
+// bits their nibble allows, so a bit left after anding all three is an
+// error. Continuation bytes past the second are checked apart.
+enum utf8_errors {
+	TOO_SHORT = 1 << 0,	// Lead or ASCII where a continuation is due
+	TOO_LONG = 1 << 1,	// Continuation after ASCII
+	OVERLONG_3 = 1 << 2,	// E0 80 to E0 9F
+	TOO_LARGE = 1 << 3,	// Past U+10FFFF
+	SURROGATE = 1 << 4,	// ED A0 to ED BF
+	OVERLONG_2 = 1 << 5,	// C0 and C1
+	TOO_LARGE_1000 = 1 << 6,	// F5 and above followed by 80 to 8F
+	OVERLONG_4 = 1 << 6,	// F0 80 to F0 8F
+	TWO_CONTS = 1 << 7,	// Continuation after continuation
+	CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS
+};
+
+static const unsigned char first_high[16] = {
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+	TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+	TOO_SHORT | OVERLONG_2,
+	TOO_SHORT,
+	TOO_SHORT | OVERLONG_3 | SURROGATE,
+	TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+};
+
+static const unsigned char first_low[16] = {
+	CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+	CARRY | OVERLONG_2,
+	CARRY,
+	CARRY,
+	CARRY | TOO_LARGE,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000
+};
+
+static const unsigned char second_high[16] = {
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000
+	    | OVERLONG_4,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+};
+
+__attribute__((target("avx2")))
+static __m256i lookup(const unsigned char *table, __m256i nibbles)
+// Maps each nibble of nibbles to its entry of the 16-byte table.
+{
+	__m128i entries = _mm_loadu_si128((const __m128i *)table);
+	return (_mm256_shuffle_epi8(_mm256_broadcastsi128_si256(entries),
+				    nibbles));
+}
+
+__attribute__((target("avx2")))
+static __m256i equal(__m256i bytes, unsigned char byte)
+// Sets each byte of bytes that is byte to all ones, the rest to 0.
+{
+	return (_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8((char)byte)));
+}
+
+__attribute__((target("avx2")))
+static __m256i find_spaces(__m256i input, __m256i prev_1, __m256i prev_2)
+// Marks each byte of input that ends the encoding of a character
+// is_space() accepts, given the 2 bytes before each.
+{
+	// U+0085 and U+00A0
+	__m256i found = _mm256_and_si256(equal(prev_1, 0xC2),
+					 _mm256_or_si256(equal(input, 0x85),
+							 equal(input, 0xA0)));
+	// U+1680
+	found = _mm256_or_si256(found, _mm256_and_si256(
+			_mm256_and_si256(equal(prev_2, 0xE1),
+					 equal(prev_1, 0x9A)),
+			equal(input, 0x80)));
+	// U+2000 to U+200A, U+2028, U+2029 and U+202F
+	__m256i general = _mm256_or_si256(
+		_mm256_cmpeq_epi8(_mm256_min_epu8(input,
+						  _mm256_set1_epi8((char)0x8A)),
+				  input),
+		_mm256_or_si256(_mm256_or_si256(equal(input, 0xA8),
+						equal(input, 0xA9)),
+				equal(input, 0xAF)));
+	__m256i after_e2 = equal(prev_2, 0xE2);
+	found = _mm256_or_si256(found, _mm256_and_si256(
+			_mm256_and_si256(after_e2, equal(prev_1, 0x80)),
+			general));
+	// U+205F
+	found = _mm256_or_si256(found, _mm256_and_si256(
+			_mm256_and_si256(after_e2, equal(prev_1, 0x81)),
+			equal(input, 0x9F)));
+	// U+3000
+	return (_mm256_or_si256(found, _mm256_and_si256(
+			_mm256_and_si256(equal(prev_2, 0xE3),
+					 equal(prev_1, 0x80)),
+			equal(input, 0x80))));
+}
+
+__attribute__((target("avx2")))
+static bool valid_avx2(const unsigned char *bytes, size_t len, bool *spaces)
+// valid_scalar() 32 bytes at a time, after Keiser and Lemire's
+// "Validating UTF-8 In Less Than One Instruction Per Byte": every byte
+// is checked against the 3 before it at once, and blocks of ASCII
+// only need to see that the block before did not end mid-sequence.
+// Whitespace is looked for the same way until some is found; bytes
+// the check fails may be taken for it.
+{
+	const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+	// A block may end in a lead byte only this far from its end
+	const __m256i last_leads = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1,
+						    -1, -1, -1, -1, -1, -1,
+						    -1, -1, -1, -1, -1, -1,
+						    -1, -1, -1, -1, -1, -1,
+						    -1, -1, -1, -1, -1,
+						    (char)(0xF0 - 1),
+						    (char)(0xE0 - 1),
+						    (char)(0xC0 - 1));
+	__m256i before = _mm256_setzero_si256();
+	__m256i incomplete = _mm256_setzero_si256();
+	__m256i error = _mm256_setzero_si256();
+	unsigned char tail[32];
+	for (size_t i = 0; i < len; i += 32) {
+		__m256i input;
+		if (len - i < 32) {
+			// Case: Short final block, pad with ASCII
+			memset(tail, 0, sizeof(tail));
+			memcpy(tail, bytes + i, len - i);
+			input = _mm256_loadu_si256((const __m256i *)tail);
+		} else {
+			input = _mm256_loadu_si256((const __m256i *)
+						   (bytes + i));
+		}
+		if (!_mm256_movemask_epi8(input)) {
+			error = _mm256_or_si256(error, incomplete);
+			before = input;
+			continue;
+		}
+		// Each byte's 1 to 3 predecessors, across the lanes and
+		// into the block before
+		__m256i joined = _mm256_permute2x128_si256(before, input, 0x21);
+		__m256i prev_1 = _mm256_alignr_epi8(input, joined, 15);
+		__m256i prev_2 = _mm256_alignr_epi8(input, joined, 14);
+		__m256i prev_3 = _mm256_alignr_epi8(input, joined, 13);
+		__m256i high_1 = _mm256_and_si256(_mm256_srli_epi16(prev_1, 4),
+						  low_nibble);
+		__m256i low_1 = _mm256_and_si256(prev_1, low_nibble);
+		__m256i high_2 = _mm256_and_si256(_mm256_srli_epi16(input, 4),
+						  low_nibble);
+		__m256i special = _mm256_and_si256(
+			_mm256_and_si256(lookup(first_high, high_1),
+					 lookup(first_low, low_1)),
+			lookup(second_high, high_2));
+		// The third and fourth bytes of a sequence must be
+		// continuations, the only case special leaves out
+		__m256i third = _mm256_subs_epu8(prev_2,
+						 _mm256_set1_epi8(0xE0 - 0x80));
+		__m256i fourth = _mm256_subs_epu8(prev_3,
+						  _mm256_set1_epi8(0xF0 - 0x80));
+		__m256i must_continue = _mm256_and_si256(
+			_mm256_or_si256(third, fourth),
+			_mm256_set1_epi8((char)0x80));
+		error = _mm256_or_si256(error, _mm256_xor_si256(must_continue,
+								special));
+		if (!*spaces) {
+			__m256i found = find_spaces(input, prev_1, prev_2);
+			*spaces = !_mm256_testz_si256(found, found);
+		}
+		incomplete = _mm256_subs_epu8(input, last_leads);
+		before = input;
+	}
+	error = _mm256_or_si256(error, incomplete);
+	return (_mm256_testz_si256(error, error));
+}
+#endif
+
+bool utf8_valid(const char *buf, size_t len, bool *spaces)
+// True if the len bytes at buf are valid UTF-8: no sequence truncated,
+// overlong, a surrogate or past U+10FFFF. If they are, *spaces is set
+// if they hold whitespace past ASCII, so need utf8_split(), and left
+// alone otherwise. Checks 32 bytes at a time where AVX2 is available.
+{
+	const unsigned char *bytes = (const unsigned char *)buf;
+#ifdef __SSE2__
+	if (__builtin_cpu_supports("avx2")) {
+		return (valid_avx2(bytes, len, spaces));
+	}
+#endif
+	return (valid_scalar(bytes, len, spaces));
+}
+
+bool utf8_valid_stream(struct utf8_stream *stream, const char *buf,
+		       size_t len, bool last, bool *spaces)
+// utf8_valid() for input arriving in parts: buf holds the next len
+// bytes, and last is set for the final part. A sequence cut off by the
+// end of one part is kept in stream, which starts zeroed, and checked
+// once the next completes it.
+{
+	const unsigned char *bytes = (const unsigned char *)buf;
+	size_t pos = 0;
+	if (stream->len) {
+		size_t size = sequence_size(stream->partial[0]);
+		while (stream->len < size && pos < len) {
+			stream->partial[stream->len++] = bytes[pos++];
+		}
+		if (stream->len < size && !last) {
+			return (true);
+		}
+		if (!sequence_length(stream->partial, stream->len)) {
+			return (false);
+		}
+		size_t next = 0;
+		if (is_space(utf8_next((const char *)stream->partial,
+				       stream->len, &next))) {
+			*spaces = true;
+		}
+		stream->len = 0;
+	}
+	size_t end = len;
+	if (!last) {
+		// Hold back a lead byte in the last 3 whose sequence does
+		// not fit
+		for (size_t back = 1; back < UTF8_MAX_BYTES && back <= len - pos;
+		     ++back) {
+			unsigned char byte = bytes[len - back];
+			if (byte >= 0xC0) {
+				if (sequence_size(byte) > back) {
+					end = len - back;
+				}
+				break;
+			}
+			if (byte < 0x80) {
+				break;
+			}
+		}
+	}
+	memcpy(stream->partial, bytes + end, len - end);
+	stream->len = len - end;
+	return (utf8_valid(buf + pos, end - pos, spaces));
+}
+
+uint32_t utf8_next(const char *str, size_t len, size_t *pos)
+// Decodes the code point at str[*pos], which must be below len, and
+// moves *pos past it. A byte that does not start a valid sequence
+// decodes as itself.
+{
+	const unsigned char *bytes = (const unsigned char *)str + *pos;
+	size_t size = sequence_length(bytes, len - *pos);
+	if (size <= 1) {
+		++*pos;
+		return (bytes[0]);
+	}
+	uint32_t code = bytes[0] & (0x7F >> size);
+	for (size_t i = 1; i < size; ++i) {
+		code = (code << 6) | (bytes[i] & 0x3F);
+	}
+	*pos += size;
+	return (code);
+}
+
+bool utf8_is_ascii(const char *word, size_t len)
+// True if the len bytes at word are all ASCII.
+{
+	return (ascii_prefix((const unsigned char *)word, len) == len);
+}
+
+void utf8_split(const char *word, size_t len,
+		void (*emit)(void *, const char *, size_t), void *ctx)
+// Passes each non-empty run of the len bytes of UTF-8 at word between
+// Unicode whitespace to emit, as tokenize() does for ASCII whitespace,
+// which word must not contain. word must be valid, as utf8_valid()
+// checks. Runs of ASCII are skipped in bulk, and only sequences whose
+// lead byte starts a space are decoded.
+{
+	const unsigned char *bytes = (const unsigned char *)word;
+	size_t start = 0;
+	size_t i = 0;
+	while (i < len) {
+		i += ascii_prefix(bytes + i, len - i);
+		if (i == len) {
+			break;
+		}
+		unsigned char lead = bytes[i];
+		size_t next = i;
+		if (lead != 0xC2 && (lead < 0xE1 || lead > 0xE3)) {
+			next += sequence_size(lead);
+		} else if (is_space(utf8_next(word, len, &next))) {
+			if (i > start) {
+				emit(ctx, word + start, i - start);
+			}
+			start = next;
+		}
+		i = next;
+	}
+	if (len > start) {
+		emit(ctx, word + start, len - start);
+	}
+}
+
+uint32_t utf8_fold(uint32_t code)
+// Lowercases code as towlower() does in the current locale, but ASCII
+// as fold_byte() does, so -i folds ASCII the same in either mode.
+{
+	if (code < 0x80) {
+		return (fold_byte(code));
+	}
+	return (towlower(code));
+}
+
+static size_t encode(uint32_t code, char *out)
+// Writes code to out as UTF-8, returning the bytes written.
+{
+	if (code < 0x80) {
+		out[0] = code;
+		return (1);
+	}
+	if (code < 0x800) {
+		out[0] = 0xC0 | (code >> 6);
+		out[1] = 0x80 | (code & 0x3F);
+		return (2);
+	}
+	if (code < 0x10000) {
+		out[0] = 0xE0 | (code >> 12);
+		out[1] = 0x80 | ((code >> 6) & 0x3F);
+		out[2] = 0x80 | (code & 0x3F);
+		return (3);
+	}
+	out[0] = 0xF0 | (code >> 18);
+	out[1] = 0x80 | ((code >> 12) & 0x3F);
+	out[2] = 0x80 | ((code >> 6) & 0x3F);
+	out[3] = 0x80 | (code & 0x3F);
+	return (4);
+}
+
+static void copy_text(char *out, const char *str, size_t len, bool fold)
+// Copies the len bytes at str to out with a terminating NUL, folding
+// each code point if fold is set. out must hold
+// UTF8_FOLD_GROWTH * len + 1 bytes if fold is set, else len + 1.
+{
+	if (!fold) {
+		memcpy(out, str, len);
+		out[len] = '\0';
+		return;
+	}
+	size_t used = 0;
+	for (size_t i = 0; i < len;) {
+		used += encode(utf8_fold(utf8_next(str, len, &i)), out + used);
+	}
+	out[used] = '\0';
+}
+
+int utf8_fold_compare(const char *str_1, size_t len_1, const char *str_2,
+		      size_t len_2)
+// Compares two UTF-8 strings by code point after utf8_fold(), which is
+// how -i tells duplicates apart in UTF-8 mode. Equal folded strings
+// may differ in length.
+{
+	size_t i = 0;
+	size_t j = 0;
+	while (i < len_1 && j < len_2) {
+		uint32_t code_1 = utf8_fold(utf8_next(str_1, len_1, &i));
+		uint32_t code_2 = utf8_fold(utf8_next(str_2, len_2, &j));
+		if (code_1 != code_2) {
+			return (code_1 > code_2 ? 1 : -1);
+		}
+	}
+	return ((i < len_1) - (j < len_2));
+}
+
+int utf8_collate(const char *str_1, size_t len_1, const char *str_2,
+		 size_t len_2, bool fold)
+// Compares two UTF-8 strings with strcoll(), after utf8_fold() if fold
+// is set. Only merging sorted runs compares this way; sort_words()
+// computes collation keys instead. Short strings are copied to the
+// stack; if a longer one cannot be copied to the heap, the code point
+// order is the best left to compare by.
+{
+	size_t growth = fold ? UTF8_FOLD_GROWTH : 1;
+	size_t size_1 = growth * len_1 + 1;
+	size_t size_2 = growth * len_2 + 1;
+	char stack_1[UTF8_STACK_BYTES];
+	char stack_2[UTF8_STACK_BYTES];
+	char *text_1 = size_1 <= sizeof(stack_1) ? stack_1 : malloc(size_1);
+	char *text_2 = size_2 <= sizeof(stack_2) ? stack_2 : malloc(size_2);
+	int result;
+	if (text_1 && text_2) {
+		copy_text(text_1, str_1, len_1, fold);
+		copy_text(text_2, str_2, len_2, fold);
+		result = strcoll(text_1, text_2);
+	} else if (fold) {
+		// Case: Out of memory
+		result = utf8_fold_compare(str_1, len_1, str_2, len_2);
+	} else {
+		size_t len = len_1 < len_2 ? len_1 : len_2;
+		result = memcmp(str_1, str_2, len);
+		if (!result) {
+			result = (len_1 > len_2) - (len_1 < len_2);
+		}
+	}
+	if (text_1 != stack_1) {
+		free(text_1);
+	}
+	if (text_2 != stack_2) {
+		free(text_2);
+	}
+	return (result);
+}
+
+static bool reserve(char **buf, size_t *size, size_t needed)
+// Grows the heap buffer *buf of *size bytes to hold at least needed
+// bytes, at least doubling it. Returns false if out of memory, leaving
+// it as it was.
+{
+	if (needed <= *size) {
+		return (true);
+	}
+	size_t new_size = 2 * *size > needed ? 2 * *size : needed;
+	char *tmp = realloc(*buf, new_size);
+	if (!tmp) {
+		return (false);
+	}
+	*buf = tmp;
+	*size = new_size;
+	return (true);
+}
+
+bool utf8_transform(struct utf8_scratch *scratch, const char *str,
+		    size_t len, bool fold, size_t spare, size_t *key_len)
+// Computes the strxfrm() key of the len bytes of UTF-8 at str, folded
+// first if fold is set, into scratch->key and sets *key_len to its
+// length. Keys compare with memcmp() as the strings do with
+// utf8_collate(). At least spare bytes are left free after the key.
+// scratch starts zeroed and is reused between calls. Returns false if
+// out of memory.
+{
+	size_t text_size = (fold ? UTF8_FOLD_GROWTH : 1) * len + 1;
+	if (!reserve(&scratch->text, &scratch->text_size, text_size)) {
+		return (false);
+	}
+	copy_text(scratch->text, str, len, fold);
+	size_t needed = strxfrm(scratch->key, scratch->text, scratch->key_size);
+	if (needed >= scratch->key_size || needed + spare > scratch->key_size) {
+		// Case: Key did not fit, so its contents are undefined
+		if (!reserve(&scratch->key, &scratch->key_size,
+			     needed + spare + 1)) {
+			return (false);
+		}
+		strxfrm(scratch->key, scratch->text, scratch->key_size);
+	}
+	*key_len = needed;
+	return (true);
+}
+
+void utf8_scratch_free(struct utf8_scratch *scratch)
+// Releases the buffers of scratch.
+{
+	free(scratch->text);
+	free(scratch->key);
+	scratch->text = NULL;
+	scratch->text_size = 0;
+	scratch->key = NULL;
+	scratch->key_size = 0;
+}
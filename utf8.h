@@ -0,0 +1,57 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum utf8_sizes {
+	UTF8_MAX_BYTES = 4,	// Longest encoded code point
+	UTF8_FOLD_GROWTH = 2,	// Folding a word at most doubles its bytes
+	UTF8_STACK_BYTES = 256	// Words compared without a heap copy
+};
+
+struct utf8_scratch {
+	char *text;		// NUL-terminated copy of a word, folded if
+	// asked, as the C library collation functions need
+	size_t text_size;
+	char *key;		// Collation key of text
+	size_t key_size;
+};
+
+struct utf8_stream {
+	unsigned char partial[UTF8_MAX_BYTES];	// Start of a sequence cut
+	// off by the end of the last part
+	size_t len;
+};
+
+bool utf8_start(void);
+
+bool utf8_enabled(void);
+
+bool utf8_valid(const char *buf, size_t len, bool *spaces);
+
+bool utf8_valid_stream(struct utf8_stream *stream, const char *buf,
+		       size_t len, bool last, bool *spaces);
+
+bool utf8_is_ascii(const char *word, size_t len);
+
+void utf8_split(const char *word, size_t len,
+		void (*emit)(void *, const char *, size_t), void *ctx);
+
+uint32_t utf8_next(const char *str, size_t len, size_t *pos);
+
+uint32_t utf8_fold(uint32_t code);
+
+int utf8_fold_compare(const char *str_1, size_t len_1, const char *str_2,
+		      size_t len_2);
+
+int utf8_collate(const char *str_1, size_t len_1, const char *str_2,
+		 size_t len_2, bool fold);
+
+bool utf8_transform(struct utf8_scratch *scratch, const char *str,
+		    size_t len, bool fold, size_t spare, size_t *key_len);
+
+void utf8_scratch_free(struct utf8_scratch *scratch);
+
+#endif
@@ -1,9 +1,25 @@
 #include <stdio.h>
+#include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "arena.h"
+#include "extsort.h"
+#include "hash.h"
+#include "index.h"
+#include "input.h"
+#include "output.h"
 #include "sort.h"
+#include "stats.h"
+#include "tokenize.h"
+#include "utf8.h"
 
 enum return_codes {
 	SUCCESS = 0,
@@ -13,8 +29,36 @@ enum return_codes {
 };
 
 enum buffer_sizes {
-	DEFAULT_WORD_COUNT = 32 // Arbitrary starting buffer size for words
+	DEFAULT_WORD_COUNT = 32, // Arbitrary starting buffer size for words
 	// array
+	SPILL_BYTES_PER_WORD = 4 * sizeof(struct word),	// Memory charged
+	// against --memory-limit per word: its view plus sort scratch
+	SPILL_MIN_WORDS = 1 << 12,	// Fewest words spilled as a run,
+	// whatever the limit, so runs stay few
+	LOAD_MIN_CHUNK_BYTES = 1 << 20	// Smallest part of a mapped file
+	// handed to a loader thread
+};
+
+enum select_sizes {
+	SELECT_MAX_FRACTION = 16	// -c and -C select their words without
+	// a full sort when they reach at most 1/16 of the words into either end
+};
+
+enum plan_sizes {
+	PLAN_SAMPLE_WORDS = 1 << 14,	// Words sampled to estimate duplicates
+	PLAN_MAX_DISTINCT_FRACTION = 2	// -u hashes before sorting when
+	// at most 1/2 of the sampled words are distinct
+};
+
+enum long_options {
+	MEMORY_LIMIT_OPTION = 256,	// Past every short option character
+	STATS_OPTION,
+	BIGNUM_OPTION,
+	UTF8_OPTION,
+	COUNT_OPTION,
+	FREQUENCY_OPTION,
+	BUILD_INDEX_OPTION,
+	INDEX_OPTION
 };
 
 static struct {
@@ -31,30 +75,151 @@ static struct {
 	bool scrabble_validation;
 	bool reversed;
 	bool unique;
+	bool merge_only;	// Input files are already sorted, -m
+	bool utf8;		// Input is UTF-8, split on Unicode whitespace
+	// and collated by the locale, --utf8
+	bool count;		// Words are interned as they are loaded and
+	// printed once each after their count, --count
+	size_t threads;	// Sort and load threads, 0 until defaulted to
+	// core count
+	size_t memory_limit;	// Bytes of words held before spilling a
+	// sorted run to disk, 0 for no limit
+	const char *build_index;	// Index file to write the sorted
+	// words to instead of printing them, --build-index
+	const char *index;	// Index file to answer from instead of
+	// reading input, --index
 } options =
-    { ascii_sort, 0, 0, true, false, false, false, false, false, false };
+    { ascii_sort, 0, 0, true, false, false, false, false, false, false,
+	false, false, false, 0, 0, NULL, NULL
+};
+
+struct file_map {
+	void *addr;
+	size_t len;
+};
 
 struct words_array {
-	char **words;
+	struct word *words;	// Views into arena or into maps
+	size_t words_len;
+	size_t words_max;	// Allocated length of words
+	struct arena *arena;	// Owns the bytes of words read from streams
+	struct file_map *maps;	// Input files mapped in place
+	size_t maps_len;
+	struct ext_sort *ext;	// If set, receives a sorted run whenever
+	// the words held exceed options.memory_limit
+	bool invalid_utf8;	// A file loaded with --utf8 was not UTF-8
+	struct word_set interned;	// Views of words, with --count,
+	// each the first of its duplicates
+};
+
+struct load_task {
+	const char *buf;	// Part of a mapped file, ending in a newline
+	// or at the end of the file
+	size_t len;
+	struct word *words;	// Views of the words in buf, in order
 	size_t words_len;
+	size_t words_max;
+	bool failed;		// Out of memory, words is incomplete
+	bool invalid_utf8;	// buf was not UTF-8, with --utf8
 };
 
-struct words_array *load_words(char **input_files, size_t count_files);
-struct words_array *load_words_interactively(void);
-void prune_scrabble_words(struct words_array *current_array);
+struct file_task {
+	const char *name;
+	struct words_array *array;	// Words of this file alone
+	bool failed;		// Out of memory while sorting
+};
+
+struct file_pool {
+	struct file_task *tasks;
+	size_t tasks_len;
+	size_t next;		// First task not yet taken by a thread
+	size_t threads_per_task;	// Load and sort threads within a task
+	pthread_mutex_t lock;	// Guards next
+};
+
+struct word_source {
+	int (*next)(void *, struct word *);	// Stores the next word,
+	// returning 1, or returns 0 at the end and -1 on error
+	void *ctx;
+	bool stable;		// Words stay valid after the next call
+};
+
+struct stream_dedup {
+	struct arena *arena;	// Copies of the words in seen, or NULL if
+	// the words outlive the set
+	struct word first;	// First word of the current run of words
+	// that compare equal, or NULL before the first word
+	struct word_set seen;	// Distinct words of that run
+};
+
+struct stage_plan {
+	bool prefilter_scrabble;	// -S before the words are ordered
+	bool prefilter_unique;	// -u by hashing before the words are ordered
+	bool order;		// Sort or select the words; off for -m
+	bool unique;		// -u on the ordered words
+	bool window;		// -c/-C on the ordered words
+};
+
+struct words_array *create_words_array(void);
+void free_words_array(struct words_array *current_array);
+void append_word(struct words_array *current_array, const char *word,
+		 size_t len);
+void store_word(struct words_array *current_array, const char *word,
+		size_t len);
+void count_word(struct words_array *current_array, const char *word,
+		size_t len);
+void load_parallel(struct words_array *current_array, const char *buf,
+		   size_t len, size_t chunks);
+bool load_mapped(struct words_array *current_array, int fd,
+		 size_t threads);
+void load_file(struct words_array *current_array, const char *name, int fd,
+	       size_t threads);
+void load_path(struct words_array *current_array, const char *name,
+	       size_t threads);
+void load_words(struct words_array *current_array, char **input_files,
+		size_t count_files);
+void load_words_interactively(struct words_array *current_array);
+void spill_run(struct words_array *current_array);
+int ext_source_next(void *ext, struct word *word);
+int run_source_next(void *merge, struct word *word);
+int print_files(char **input_files, size_t count_files);
+int print_merged(struct word_source *source);
+int write_index(struct words_array *current_array);
+int print_index(const char *name);
+bool is_stream_duplicate(struct stream_dedup *dedup, const struct word *word);
+bool parse_size(const char *str, size_t *size);
+void words_window(size_t len, size_t num_from_top, size_t num_from_bottom,
+		  bool top_to_bottom, bool top_flag, bool bottom_flag,
+		  size_t *start, size_t *end);
 void prune_num_words(struct words_array *current_array, size_t num_from_top,
 		     size_t num_from_bottom, bool top_to_bottom, bool top_flag,
 		     bool bottom_flag);
-void prune_duplicates(struct words_array *current_array, bool case_sensitive);
-void resize_array(struct words_array *current_array);
+void prune_words(struct words_array *current_array, bool scrabble,
+		 bool unique, int (*algorithm)(const void *, const void *),
+		 bool case_insensitive);
+bool mostly_duplicates(const struct words_array *current_array);
+void plan_stages(struct stage_plan *plan,
+		 const struct words_array *current_array);
 
 int main(int argc, char *argv[])
 {
 	int opt;
 	char *err = '\0';
+	static const struct option long_options[] = {
+		{ "memory-limit", required_argument, NULL, MEMORY_LIMIT_OPTION },
+		{ "stats", optional_argument, NULL, STATS_OPTION },
+		{ "bignum", no_argument, NULL, BIGNUM_OPTION },
+		{ "utf8", no_argument, NULL, UTF8_OPTION },
+		{ "count", no_argument, NULL, COUNT_OPTION },
+		{ "frequency", no_argument, NULL, FREQUENCY_OPTION },
+		{ "build-index", required_argument, NULL, BUILD_INDEX_OPTION },
+		{ "index", required_argument, NULL, INDEX_OPTION },
+		{ NULL, 0, NULL, 0 }
+	};
 	// Option-handling syntax borrowed from Liam Echlin in
 	// getopt-demo.c
-	while ((opt = getopt(argc, argv, "ac:C:hilnrsSu")) != -1) {
+	while ((opt = getopt_long(argc, argv, "ac:C:hij:lmnrsSu", long_options,
+				  NULL)) != -1) {
 
 		switch (opt) {
 			// a[scii sort]
@@ -85,10 +250,39 @@ int main(int argc, char *argv[])
 			options.algorithm = scrabble_sort;
 			options.scrabble_validation = true;
 			break;
+			// m[erge sorted input]
+		case 'm':
+			options.merge_only = true;
+			break;
 			// n[umerical sort]
 		case 'n':
 			options.algorithm = num_sort;
 			break;
+			// bignum
+		case BIGNUM_OPTION:
+			options.algorithm = big_num_sort;
+			break;
+			// utf8
+		case UTF8_OPTION:
+			options.utf8 = true;
+			break;
+			// count
+		case COUNT_OPTION:
+			options.count = true;
+			break;
+			// frequency
+		case FREQUENCY_OPTION:
+			options.algorithm = count_sort;
+			options.count = true;
+			break;
+			// build-index
+		case BUILD_INDEX_OPTION:
+			options.build_index = optarg;
+			break;
+			// index
+		case INDEX_OPTION:
+			options.index = optarg;
+			break;
 			// u[nique]
 		case 'u':
 			options.unique = true;
@@ -121,6 +315,37 @@ int main(int argc, char *argv[])
 			options.top_to_bottom = true;
 			options.bottom_flag = true;
 			break;
+			// j[obs]
+		case 'j':
+			err = '\0';
+			long int threads = strtol(optarg, &err, 10);
+			if (*err || threads < 1) {
+				fprintf(stderr, "%s is not a positive number.\n",
+					optarg);
+				return (INVOCATION_ERROR);
+			}
+			options.threads = threads;
+			break;
+			// memory-limit
+		case MEMORY_LIMIT_OPTION:
+			if (!parse_size(optarg, &options.memory_limit)) {
+				fprintf(stderr, "%s is not a valid size.\n",
+					optarg);
+				return (INVOCATION_ERROR);
+			}
+			break;
+			// stats
+		case STATS_OPTION:
+			if (!optarg || !strcmp(optarg, "human")) {
+				stats.format = STATS_HUMAN;
+			} else if (!strcmp(optarg, "json")) {
+				stats.format = STATS_JSON;
+			} else {
+				fprintf(stderr, "%s is not a stats format.\n",
+					optarg);
+				return (INVOCATION_ERROR);
+			}
+			break;
 			// h[elp message]
 		case 'h':
 			printf("Usage: %s [OPTION]... [FILE]...\n", argv[0]);
@@ -130,16 +355,42 @@ int main(int argc, char *argv[])
 				 "  -a,          ASCII codepoint sort\n" 
 				 "  -l,          Length-of-word sort\n" 
 				 "  -n,          Numerical sort\n" 
+				 "  --bignum,    Numerical sort, comparing numbers of any length\n"
+				 "                 exactly\n"
 				 "  -s,          Scrabble-score sort\n" 
-				 "  -S,          Scrabble-score sort, removing invalid words\n\n"
+				 "  -S,          Scrabble-score sort, removing invalid words\n"
+				 "  --frequency, Sort by number of occurrences, implies --count\n\n"
 				 "Other options:\n\n" 
 				 "  -u,          Display only unique words\n" 
+				 "  --count,     Display each distinct word once, after the number\n"
+				 "                 of times it occurs\n"
 				 "  -i,          Case insensitive sort\n" 
+				 "  -j NUM,      Loads and sorts using NUM threads. Defaults to the\n"
+				 "                 number of online processors.\n"
+				 "  -m,          Merges input that is already sorted by the chosen\n"
+				 "                 sort without sorting it again.\n"
 				 "  -c NUM,      Prints only first NUM lines from sorted output.\n" 
 				 "  -C NUM,      Prints only last NUM lines from sorted output.\n" 
 				 "               When -c and -C are combined, operations are applied\n" 
 				 "                 in order, for example, -c 20 -C 4 prints the last\n" 
 				 "                 4 of the first 20 sorted words.\n" 
+				 "  --memory-limit SIZE,\n"
+				 "               Sorts input that does not fit in SIZE bytes in\n"
+				 "                 runs spilled to temporary files. SIZE may end\n"
+				 "                 in K, M or G.\n"
+				 "  --stats[=human|json],\n"
+				 "               Reports phase timings, comparison counts and\n"
+				 "                 memory use to standard error on exit.\n"
+				 "  --build-index FILE,\n"
+				 "               Writes the sorted words to the index FILE instead\n"
+				 "                 of printing them.\n"
+				 "  --index FILE,\n"
+				 "               Answers -c, -C, -r and -u from the index FILE,\n"
+				 "                 built with the same sort options, without\n"
+				 "                 reading or sorting any input.\n"
+				 "  --utf8,      Reads input as UTF-8, splitting words on Unicode\n"
+				 "                 whitespace too. -a and -i collate by the locale\n"
+				 "                 and -i folds case by character.\n"
 				 "  -h           Display this help message and exit.\n\n" 
 				 "Examples:\n" 
 				 "  ws -i -u [FILE]   Print contents of FILE, removing duplicate\n" 
@@ -152,552 +403,1245 @@ int main(int argc, char *argv[])
 	}
 	argc -= optind;
 	argv += optind;
+	if (options.count && options.merge_only) {
+		fprintf(stderr, "--count cannot be combined with -m.\n");
+		return (INVOCATION_ERROR);
+	}
+	if (options.build_index && (options.top_flag || options.bottom_flag
+				    || options.reversed || options.unique
+				    || options.merge_only || options.count
+				    || options.index)) {
+		fprintf(stderr, "--build-index cannot be combined with -c, -C, "
+			"-r, -u, -m, --count or --index.\n");
+		return (INVOCATION_ERROR);
+	}
+	if (options.index && (options.merge_only || options.count)) {
+		fprintf(stderr, "--index cannot be combined with -m or "
+			"--count.\n");
+		return (INVOCATION_ERROR);
+	}
+	if (options.index && argc > 0) {
+		fprintf(stderr, "--index takes no input files.\n");
+		return (INVOCATION_ERROR);
+	}
+	if (options.utf8) {
+		if (!utf8_start()) {
+			fprintf(stderr, "No UTF-8 locale is available.\n");
+			return (INVOCATION_ERROR);
+		}
+		if (options.algorithm == ascii_sort) {
+			options.algorithm = collate_sort;
+		} else if (options.algorithm == insensitive_ascii_sort) {
+			options.algorithm = insensitive_collate_sort;
+		}
+	}
+	if (stats.format) {
+		atexit(stats_report);
+	}
+	if (options.index) {
+		// Case: Answer from a sorted index, reading no input
+		return (print_index(options.index));
+	}
+	if (!options.threads) {
+		long int online = sysconf(_SC_NPROCESSORS_ONLN);
+		options.threads = online > 0 ? online : 1;
+	}
 	if (argc > 0) {
-		// Validates that given files are able to be opened
+		// Validates that given files are able to be opened. Each is
+		// closed again at once and reopened when it is loaded, so any
+		// number of files can be given whatever the descriptor limit
 		bool close_flag = false;
 		for (int i = 0; i < argc; ++i) {
-			FILE *fo = fopen(argv[i], "r");
-			if (!fo) {	// If file could not be opened for reading
-				close_flag = true;	// Close after all files checked
+			int fd = open(argv[i], O_RDONLY);
+			if (fd < 0) {	// If file could not be opened for reading
+				close_flag = true;	// Exit after all files checked
 				fprintf(stderr, "%s could not be opened",
 					argv[i]);
 				perror(" \b");	// Backspace to format perror string
 			} else {
-				fclose(fo);
+				close(fd);
 			}
 		}
 		if (close_flag == true) {
 			return (INVOCATION_ERROR);
 		}
+		if (options.merge_only || (argc > 1 && options.threads > 1
+					   && !options.memory_limit
+					   && !options.count
+					   && !options.build_index)) {
+			// Case: Sort each file on its own and merge them
+			return (print_files(argv, argc));
+		}
 	}
 
-	struct words_array *current_array;
+	struct words_array *current_array = create_words_array();
+	if (options.memory_limit && !options.merge_only && !options.count
+	    && !options.build_index) {
+		current_array->ext = ext_create(options.algorithm);
+		if (!current_array->ext) {
+			free_words_array(current_array);
+			fprintf(stderr, "Memory allocation error.\n");
+			return (MEMORY_ERROR);
+		}
+	}
+	stats_begin(STATS_LOAD);
 	if (argc > 0) {
-		current_array = load_words(argv, argc);
+		load_words(current_array, argv, argc);
 	} else {
-		current_array = load_words_interactively();
+		load_words_interactively(current_array);
 	}
+	stats_end(STATS_LOAD);
 
+	if (current_array->ext && current_array->ext->runs_len) {
+		// Case: Input did not fit in memory, merge the spilled runs
+		if (current_array->words_len) {
+			spill_run(current_array);
+		}
+		struct ext_sort *ext = current_array->ext;
+		current_array->ext = NULL;
+		free_words_array(current_array);
+		int result = FILE_ERROR;
+		stats_begin(STATS_MERGE);
+		bool started = ext_merge_start(ext);
+		if (started) {
+			struct word_source source = { ext_source_next, ext,
+				false
+			};
+			result = print_merged(&source);
+		}
+		stats_end(STATS_MERGE);
+		if (!started) {
+			perror("Temporary file could not be read");
+		}
+		ext_destroy(ext);
+		return (result);
+	}
+
+	stats_add_words(current_array->words, current_array->words_len);
 	if (current_array->words_len) {
 		// Case: Number of valid words across all files > 0
 
-		qsort(current_array->words, current_array->words_len,
-		      sizeof(*(current_array->words)), options.algorithm);
+		struct stage_plan plan;
+		plan_stages(&plan, current_array);
+		if (plan.prefilter_scrabble || plan.prefilter_unique) {
+			prune_words(current_array, plan.prefilter_scrabble,
+				    plan.prefilter_unique, NULL,
+				    options.case_insens);
+		}
 
-		if (options.scrabble_validation) {
-			prune_scrabble_words(current_array);
-			resize_array(current_array);
+		size_t start = 0;
+		size_t end = 0;
+		bool select = false;
+		if (plan.window && !plan.unique) {
+			// Size the -c/-C window against what the filters
+			// left, selecting it if it is small enough
+			size_t len = current_array->words_len;
+			words_window(len, options.top_count,
+				     options.bottom_count,
+				     options.top_to_bottom, options.top_flag,
+				     options.bottom_flag, &start, &end);
+			size_t reach = end < len - start ? end : len - start;
+			// Selection compares words directly, which costs
+			// a locale lookup each time when collating
+			select = plan.order && !is_collation(options.algorithm)
+			    && reach <= len / SELECT_MAX_FRACTION;
 		}
 
-		if (options.unique) {
-			prune_duplicates(current_array, options.case_insens);
-			resize_array(current_array);
+		stats_begin(STATS_SORT);
+		if (select) {
+			if (!select_words(current_array->words,
+					  current_array->words_len, start, end,
+					  options.algorithm)) {
+				free_words_array(current_array);
+				fprintf(stderr, "Memory allocation error.\n");
+				return (MEMORY_ERROR);
+			}
+			current_array->words_len = end - start;
+		} else if (plan.order) {
+			if (!sort_words(current_array->words,
+					current_array->words_len,
+					options.algorithm, options.threads)) {
+				free_words_array(current_array);
+				fprintf(stderr, "Memory allocation error.\n");
+				return (MEMORY_ERROR);
+			}
+		}
+		stats_end(STATS_SORT);
+		if (options.build_index) {
+			return (write_index(current_array));
 		}
 
-		if (options.top_flag || options.bottom_flag) {
+		if (plan.unique) {
+			prune_words(current_array, false, true,
+				    options.algorithm, options.case_insens);
+		}
+		if (plan.window && !select) {
 			prune_num_words(current_array, options.top_count,
 					options.bottom_count,
 					options.top_to_bottom, options.top_flag,
 					options.bottom_flag);
-			resize_array(current_array);
 		}
 
 		// Print block
-		if (!options.reversed) {
-			// Case: Normal print
-			for (size_t i = 0; i < current_array->words_len; ++i) {
-				printf("%s\n", current_array->words[i]);
-			}
-		} else {
-			// Case: Reversed print
-			for (size_t i = current_array->words_len; i > 0; --i) {
-				if (current_array->words[i]) {
-				printf("%s\n", current_array->words[i]);
-				}
-			}
-			printf("%s\n", current_array->words[0]);
+		stats_begin(STATS_OUTPUT);
+		struct output *out = output_create(STDOUT_FILENO);
+		if (!out) {
+			free_words_array(current_array);
+			fprintf(stderr, "Memory allocation error.\n");
+			return (MEMORY_ERROR);
+		}
+		output_words(out, current_array->words,
+			     current_array->words_len, options.reversed,
+			     options.count);
+		bool flushed = output_flush(out);
+		stats_end(STATS_OUTPUT);
+		if (!flushed) {
+			perror("Output could not be written");
+			output_destroy(out);
+			free_words_array(current_array);
+			return (FILE_ERROR);
 		}
+		output_destroy(out);
+	} else if (options.build_index) {
+		return (write_index(current_array));
 	} else {
-		free(current_array->words);
-		free(current_array);
+		free_words_array(current_array);
 		return (SUCCESS);
 	}
 	// Free all allocated memory to current_array
-	for (size_t i = 0; i < current_array->words_len; ++i) {
-		free(current_array->words[i]);
-	}
-	free(current_array->words);
-	free(current_array);
+	free_words_array(current_array);
 
 	// Case: Valid words sorted
 	return (SUCCESS);
 }
 
-struct words_array *load_words(char **input_files, size_t count_files)
-// Iterates through each file passed to it, tokenizing individual
-// words on any whitespace character and returning a pointer to a
-// struct words_array with pointers to strings and a count of 
-// total words populated.
+struct words_array *create_words_array(void)
+// Returns a pointer to an empty struct words_array whose word bytes
+// will be stored in a freshly created arena.
 {
-	char **words = calloc(DEFAULT_WORD_COUNT, sizeof(*words));
-	if (!words) {
+	struct words_array *current_array = malloc(sizeof(*current_array));
+	if (!current_array) {
 		// Case: Out of memory
 		fprintf(stderr, "Memory allocation error.\n");
 		exit(MEMORY_ERROR);
 	}
-	size_t words_len = 0;
-	size_t current_max = DEFAULT_WORD_COUNT;
-	for (size_t i = 0; i < count_files; ++i) {
-		FILE *fo = fopen(input_files[i], "r");
-		if (!fo) {
-			fprintf(stderr, "%s could not be opened",
-				input_files[0]);
-			perror(" \b");
-			exit(FILE_ERROR);
+	current_array->maps = NULL;
+	current_array->maps_len = 0;
+	current_array->ext = NULL;
+	current_array->invalid_utf8 = false;
+	word_set_init(&current_array->interned, options.case_insens);
+	current_array->words = calloc(DEFAULT_WORD_COUNT,
+				      sizeof(*current_array->words));
+	current_array->arena = arena_create();
+	if (!current_array->words || !current_array->arena) {
+		// Case: Out of memory
+		free_words_array(current_array);
+		fprintf(stderr, "Memory allocation error.\n");
+		exit(MEMORY_ERROR);
+	}
+	current_array->words_len = 0;
+	current_array->words_max = DEFAULT_WORD_COUNT;
+	return (current_array);
+}
+
+void free_words_array(struct words_array *current_array)
+// Releases the word array, every mapped input file and, in one pass
+// over the arena chunks, every word stored for current_array.
+{
+	for (size_t i = 0; i < current_array->maps_len; ++i) {
+		munmap(current_array->maps[i].addr, current_array->maps[i].len);
+	}
+	free(current_array->maps);
+	ext_destroy(current_array->ext);
+	word_set_free(&current_array->interned);
+	arena_destroy(current_array->arena);
+	free(current_array->words);
+	free(current_array);
+}
+
+void append_word(struct words_array *current_array, const char *word,
+		 size_t len)
+// Appends a view of the len bytes at word to current_array, growing
+// the word array as needed. The bytes are not copied.
+{
+	if (current_array->words_len == current_array->words_max) {
+		size_t new_max = 2 * current_array->words_max;
+		if (new_max < DEFAULT_WORD_COUNT) {
+			new_max = DEFAULT_WORD_COUNT;
 		}
-		char *line_buf = NULL;
-		size_t buf_size = 0;
-		while (getline(&line_buf, &buf_size, fo) != -1) {
-			if (line_buf[0] == '\n') {
-				continue;
-			}
-			char *current_word = strtok(line_buf, " \t\n\v\f\r");
-			char *current_word_stored;
-			if (words_len == current_max) {
-				// Realloc syntax from Liam Echlin
-				char **tmp = realloc(words,
-						     (2 * current_max *
-						      sizeof(*words)));
-				if (!tmp) {
-					for (size_t i = 0; i < words_len; ++i) {
-						free(words[i]);
-					}
-					free(words);
-					fprintf(stderr,
-						"Memory allocation error.\n");
-					exit(MEMORY_ERROR);
-				}
-				current_max *= 2;
-				words = tmp;
-			}
-			if (current_word) {
-				current_word_stored =
-				    calloc((strlen(current_word) +
-					    1), sizeof(*current_word));
-				if (!current_word_stored) {
-					// Case: Out of memory
-					for (size_t i = 0; i < words_len; ++i) {
-						free(words[i]);
-					}
-					free(words);
-					fprintf(stderr,
-						"Memory allocation error.\n");
-					exit(MEMORY_ERROR);
-				}
-				strncpy(current_word_stored, current_word, 
-					    strlen(current_word));
-				words[words_len] = current_word_stored;
-				++words_len;
-			}
+		// Realloc syntax from Liam Echlin
+		struct word *tmp = realloc(current_array->words,
+					   (new_max *
+					    sizeof(*current_array->words)));
+		if (!tmp) {
+			free_words_array(current_array);
+			fprintf(stderr, "Memory allocation error.\n");
+			exit(MEMORY_ERROR);
+		}
+		current_array->words_max = new_max;
+		current_array->words = tmp;
+	}
+	current_array->words[current_array->words_len].str = word;
+	current_array->words[current_array->words_len].len = len;
+	++current_array->words_len;
 
-			while ((current_word =
-				strtok(NULL, " \t\n\v\f\r")) != NULL) {
-				// Reallocate memory if needed
-				if (words_len == current_max) {
-					char **tmp = realloc(words,
-							     (2 *
-							      current_max
-							      *
-							      sizeof(*words)));
-					if (!tmp) {
-						for (size_t i = 0;
-						     i < words_len; ++i) {
-							free(words[i]);
-						}
-						free(words);
-						fprintf(stderr,
-							"Memory allocation error.\n");
-						exit(MEMORY_ERROR);
-					}
-					current_max *= 2;
-					words = tmp;
-				}
-				current_word_stored = NULL;
-				if (current_word) {
-					current_word_stored =
-					    calloc(strlen(current_word) + 1,
-						   sizeof(char));
-					if (!current_word_stored) {
-						// Case: Out of memory
-						for (size_t i = 0;
-						     i < words_len; ++i) {
-							free(words[i]);
-						}
-						free(words);
-						fprintf(stderr,
-							"Memory allocation error.\n");
-						exit(MEMORY_ERROR);
-					}
-
-					strncpy(current_word_stored,
-						current_word,
-						strlen(current_word) +
-						1);
-					words[words_len] = current_word_stored;
-					++words_len;
-				}
-			}
+	if (current_array->ext
+	    && current_array->words_len >= SPILL_MIN_WORDS) {
+		// Charge the array as it would be after its next growth,
+		// and only the arena bytes in use: a reset arena keeps its
+		// last chunk
+		size_t max = current_array->words_max;
+		if (current_array->words_len == max) {
+			max *= 2;
 		}
-		if (line_buf) {
-			free(line_buf);
+		if (max * SPILL_BYTES_PER_WORD +
+		    current_array->arena->used_bytes > options.memory_limit) {
+			spill_run(current_array);
 		}
-		fclose(fo);
 	}
-	struct words_array *current_array = malloc(sizeof(*current_array));
-	if (!current_array) {
+}
+
+void store_word(struct words_array *current_array, const char *word,
+		size_t len)
+// Copies the len bytes at word into the arena of current_array and
+// appends a view of the copy.
+{
+	char *current_word_stored = arena_store(current_array->arena, word,
+						len);
+	if (!current_word_stored) {
 		// Case: Out of memory
-		for (size_t i = 0; i < words_len; ++i) {
-			free(current_array->words[i]);
-		}
-		free(words);
+		free_words_array(current_array);
 		fprintf(stderr, "Memory allocation error.\n");
 		exit(MEMORY_ERROR);
 	}
-	current_array->words_len = words_len;
-	current_array->words = words;
-	return (current_array);
+	append_word(current_array, current_word_stored, len);
 }
 
-struct words_array *load_words_interactively(void)
-// This is functionally the same as load words, but accepting from
-// stdin instead of from a file.
+void count_word(struct words_array *current_array, const char *word,
+		size_t len)
+// Interns the len bytes at word for --count. A word seen before only
+// has its count raised; a new one is copied into the arena of
+// current_array once, after a count of 1, and a view of the copy is
+// appended. Duplicates are never stored, so memory grows with the
+// distinct words rather than with the input.
 {
-	char **words = calloc(DEFAULT_WORD_COUNT, sizeof(*words));
-	if (!words) {
+	struct word current = { word, len };
+	bool added;
+	struct word *interned = word_set_insert(&current_array->interned,
+						&current, &added);
+	char *stored = NULL;
+	size_t count = 1;
+	if (interned && added) {
+		stored = arena_alloc(current_array->arena, sizeof(count) + len);
+	}
+	if (!interned || (added && !stored)) {
 		// Case: Out of memory
+		free_words_array(current_array);
 		fprintf(stderr, "Memory allocation error.\n");
 		exit(MEMORY_ERROR);
 	}
-	size_t words_len = 0;
-	size_t current_max = DEFAULT_WORD_COUNT;
+	if (!added) {
+		// The count sits in the arena, just before the copy
+		count = word_count(interned) + 1;
+		memcpy((char *)interned->str - sizeof(count), &count,
+		       sizeof(count));
+		return;
+	}
+	memcpy(stored, &count, sizeof(count));
+	memcpy(stored + sizeof(count), word, len);
+	interned->str = stored + sizeof(count);
+	append_word(current_array, interned->str, len);
+}
 
-	char *line_buf = NULL;
-	size_t buf_size = 0;
-	while (getline(&line_buf, &buf_size, stdin) != -1) {
-		if (line_buf[0] == '\n') {
-			continue;
+static void emit_view(void *current_array, const char *word, size_t len)
+// tokenize() callback for input that outlives the words array.
+{
+	if (options.count) {
+		count_word(current_array, word, len);
+	} else {
+		append_word(current_array, word, len);
+	}
+}
+
+static void emit_copy(void *current_array, const char *word, size_t len)
+// tokenize() callback for input read into a reused buffer.
+{
+	if (options.count) {
+		count_word(current_array, word, len);
+	} else {
+		store_word(current_array, word, len);
+	}
+}
+
+static void emit_task(void *task, const char *word, size_t len)
+// tokenize() callback collecting views into a load_task.
+{
+	struct load_task *load = task;
+	if (load->failed) {
+		return;
+	}
+	if (load->words_len == load->words_max) {
+		size_t new_max = 2 * load->words_max;
+		if (new_max < DEFAULT_WORD_COUNT) {
+			new_max = DEFAULT_WORD_COUNT;
 		}
-		char *current_word = strtok(line_buf, " \t\n\v\f\r");
-		char *current_word_stored;
-		if (words_len == current_max) {
-			// Realloc syntax from Liam Echlin
-			char **tmp = realloc(words,
-					     (2 * current_max *
-					      sizeof(*words)));
-			if (!tmp) {
-				for (size_t i = 0; i < words_len; ++i) {
-					free(words[i]);
-				}
-				free(words);
-				fprintf(stderr, "Memory allocation error.\n");
-				exit(MEMORY_ERROR);
-			}
-			current_max *= 2;
-			words = tmp;
-		}
-		if (current_word) {
-			current_word_stored = calloc((strlen(current_word) + 1), 
-										 sizeof(*current_word));
-			if (!current_word_stored) {
-				// Case: Out of memory
-				for (size_t i = 0; i < words_len; ++i) {
-					free(words[i]);
-				}
-				free(words);
-				fprintf(stderr, "Memory allocation error.\n");
-				exit(MEMORY_ERROR);
-			}
-			strncpy(current_word_stored, current_word, strlen(current_word));
-			words[words_len] = current_word_stored;
-			++words_len;
-		}
-
-		while ((current_word = strtok(NULL, " \t\n\v\f\r")) != NULL) {
-			// Reallocate memory if needed
-			if (words_len == current_max) {
-				char **tmp = realloc(words,
-						     (2 *
-						      current_max
-						      * sizeof(*words)));
-				if (!tmp) {
-					for (size_t i = 0; i < words_len; ++i) {
-						free(words[i]);
-					}
-					free(words);
-					fprintf(stderr,
-						"Memory allocation error.\n");
-					exit(MEMORY_ERROR);
-				}
-				current_max *= 2;
-				words = tmp;
-			}
-			current_word_stored = NULL;
-			if (current_word) {
-				current_word_stored =
-				    calloc(strlen(current_word)
-					   + 1, sizeof(char));
-				if (!current_word_stored) {
-					// Case: Out of memory
-					for (size_t i = 0; i < words_len; ++i) {
-						free(words[i]);
-					}
-					free(words);
-					fprintf(stderr,
-						"Memory allocation error.\n");
-					exit(MEMORY_ERROR);
-				}
-
-				strncpy(current_word_stored, current_word, 
-					    strlen(current_word));
-				words[words_len] = current_word_stored;
-				++words_len;
-			}
+		struct word *tmp = realloc(load->words,
+					   new_max * sizeof(*load->words));
+		if (!tmp) {
+			load->failed = true;
+			return;
 		}
+		load->words_max = new_max;
+		load->words = tmp;
 	}
-	if (line_buf) {
-		free(line_buf);
+	load->words[load->words_len].str = word;
+	load->words[load->words_len].len = len;
+	++load->words_len;
+}
+
+// tokenize() callbacks in place of the emit ones for input validated
+// by utf8_valid() and found to hold Unicode whitespace. Only words
+// holding bytes past ASCII can hold it, so only they are split.
+static void split_view(void *current_array, const char *word, size_t len)
+{
+	if (utf8_is_ascii(word, len)) {
+		emit_view(current_array, word, len);
+	} else {
+		utf8_split(word, len, emit_view, current_array);
 	}
-	struct words_array *current_array = malloc(sizeof(*current_array));
-	if (!current_array) {
-		// Case: Out of memory
-		for (size_t i = 0; i < words_len; ++i) {
-			free(current_array->words[i]);
-		}
-		free(words);
-		fprintf(stderr, "Memory allocation error.\n");
-		exit(MEMORY_ERROR);
+}
+
+static void split_copy(void *current_array, const char *word, size_t len)
+{
+	if (utf8_is_ascii(word, len)) {
+		emit_copy(current_array, word, len);
+	} else {
+		utf8_split(word, len, emit_copy, current_array);
 	}
-	current_array->words_len = words_len;
-	current_array->words = words;
-	return (current_array);
 }
 
-void prune_num_words(struct words_array *current_array, size_t num_from_top,
-		     size_t num_from_bottom, bool top_to_bottom, bool top_flag,
-		     bool bottom_flag)
-// Prunes the top or bottom n numbers from the file based on the given
-// -c and -C options by setting everything outside of those values to
-// NULL.
+static void split_task(void *task, const char *word, size_t len)
 {
-	if (top_flag && bottom_flag) {
-		if (num_from_top > current_array->words_len) {
-			num_from_top = current_array->words_len;
+	if (utf8_is_ascii(word, len)) {
+		emit_task(task, word, len);
+	} else {
+		utf8_split(word, len, emit_task, task);
+	}
+}
+
+static void *load_chunk(void *task)
+// Thread body tokenizing the part of a mapped file given by task,
+// validated first with --utf8.
+{
+	struct load_task *load = task;
+	bool spaces = false;
+	if (options.utf8 && !utf8_valid(load->buf, load->len, &spaces)) {
+		load->invalid_utf8 = true;
+		return (NULL);
+	}
+	tokenize(load->buf, load->len, true, spaces ? split_task : emit_task,
+		 load);
+	return (NULL);
+}
+
+void load_parallel(struct words_array *current_array, const char *buf,
+		   size_t len, size_t chunks)
+// Tokenizes the len bytes of buf on up to chunks threads, appending a
+// view of each word found into current_array in the same order as a
+// single tokenize() pass. The parts are cut just after a newline, not
+// at any whitespace, so a NUL hiding the rest of its line never has
+// that line split from it.
+{
+	struct load_task *tasks = calloc(chunks, sizeof(*tasks));
+	pthread_t *ids = calloc(chunks, sizeof(*ids));
+	bool *started = calloc(chunks, sizeof(*started));
+	if (!tasks || !ids || !started) {
+		free(tasks);
+		free(ids);
+		free(started);
+		free_words_array(current_array);
+		fprintf(stderr, "Memory allocation error.\n");
+		exit(MEMORY_ERROR);
+	}
+	size_t used = 0;
+	size_t tasks_len = 0;
+	while (used < len && tasks_len < chunks) {
+		size_t cut = len;
+		if (tasks_len + 1 < chunks) {
+			cut = used + (len - used) / (chunks - tasks_len);
+			const char *newline = memchr(buf + cut, '\n', len - cut);
+			cut = newline ? (size_t)(newline - buf) + 1 : len;
 		}
-		if (num_from_bottom > current_array->words_len) {
-			num_from_bottom = current_array->words_len;
+		tasks[tasks_len].buf = buf + used;
+		tasks[tasks_len].len = cut - used;
+		++tasks_len;
+		used = cut;
+	}
+	for (size_t i = 1; i < tasks_len; ++i) {
+		started[i] = !pthread_create(&ids[i], NULL, load_chunk,
+					     &tasks[i]);
+		if (!started[i]) {
+			// Case: No thread to spare, do the work here
+			load_chunk(&tasks[i]);
 		}
-		if (top_to_bottom) {
-			if (num_from_bottom > num_from_top) {
-				num_from_bottom = num_from_top;
-			}
-			for (size_t i = num_from_top;
-			     i < current_array->words_len; ++i) {
-				// Set everything outside of first i elements to NULL
-				free(current_array->words[i]);
-				current_array->words[i] = NULL;
-			}
-			for (size_t i = 0; i < num_from_top - num_from_bottom;
-			     ++i) {
-				// Then set everything outside of last i elements to NULL
-				free(current_array->words[i]);
-				current_array->words[i] = NULL;
-			}
+	}
+	load_chunk(&tasks[0]);
+	size_t total = 0;
+	bool failed = false;
+	for (size_t i = 0; i < tasks_len; ++i) {
+		if (started[i]) {
+			pthread_join(ids[i], NULL);
+		}
+		total += tasks[i].words_len;
+		failed = failed || tasks[i].failed;
+		current_array->invalid_utf8 = current_array->invalid_utf8
+		    || tasks[i].invalid_utf8;
+	}
+	free(ids);
+	free(started);
 
+	size_t needed = current_array->words_len + total;
+	if (!failed && needed > current_array->words_max) {
+		struct word *tmp = realloc(current_array->words,
+					   needed *
+					   sizeof(*current_array->words));
+		if (tmp) {
+			current_array->words = tmp;
+			current_array->words_max = needed;
 		} else {
-			if (num_from_top > num_from_bottom) {
-				num_from_top = num_from_bottom;
-			}
-			for (size_t i = 0;
-			     i < current_array->words_len - num_from_bottom;
-			     ++i) {
-				// Set everything outside of last i elements to NULL
-				free(current_array->words[i]);
-				current_array->words[i] = NULL;
-			}
-			for (size_t i =
-			     current_array->words_len - num_from_bottom +
-			     num_from_top; i < current_array->words_len; ++i) {
-				// Then set everything outside of first i elements to NULL
-				free(current_array->words[i]);
-				current_array->words[i] = NULL;
-			}
+			failed = true;
 		}
 	}
-	if (top_flag && !bottom_flag) {
-		if (num_from_top > current_array->words_len) {
-			num_from_top = current_array->words_len;
+	stats_sample_heap();
+	for (size_t i = 0; i < tasks_len; ++i) {
+		if (!failed && tasks[i].words_len) {
+			memcpy(current_array->words + current_array->words_len,
+			       tasks[i].words,
+			       tasks[i].words_len * sizeof(*tasks[i].words));
+			current_array->words_len += tasks[i].words_len;
 		}
-		for (size_t i = num_from_top; i < current_array->words_len; ++i) {
-			// Set everything outside of first i elements to NULL
-			free(current_array->words[i]);
-			current_array->words[i] = NULL;
+		free(tasks[i].words);
+	}
+	free(tasks);
+	if (failed) {
+		free_words_array(current_array);
+		fprintf(stderr, "Memory allocation error.\n");
+		exit(MEMORY_ERROR);
+	}
+}
+
+bool load_mapped(struct words_array *current_array, int fd,
+		 size_t threads)
+// Maps the regular file open on fd and tokenizes it in place, on up
+// to threads threads if it is large. With --utf8, it is validated as
+// a whole first, or in parts by the threads. The mapping stays alive
+// until free_words_array(). Returns false if fd cannot be mapped, in
+// which case it should be read as a stream.
+{
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) < 0 || !S_ISREG(file_stat.st_mode)) {
+		return (false);
+	}
+	if (file_stat.st_size == 0) {
+		// Case: Empty, or sized 0 though it has content, as files
+		// of /proc and /sys are, so read it as a stream
+		return (false);
+	}
+	size_t len = file_stat.st_size;
+	void *addr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (addr == MAP_FAILED) {
+		return (false);
+	}
+	madvise(addr, len, MADV_SEQUENTIAL);
+	current_array->maps[current_array->maps_len].addr = addr;
+	current_array->maps[current_array->maps_len].len = len;
+	++current_array->maps_len;
+	size_t chunks = len / LOAD_MIN_CHUNK_BYTES;
+	if (chunks > threads) {
+		chunks = threads;
+	}
+	if (chunks > 1 && !current_array->ext && !options.count) {
+		// Case: Large file and no spilling, split it between threads
+		load_parallel(current_array, addr, len, chunks);
+	} else {
+		bool spaces = false;
+		if (options.utf8 && !utf8_valid(addr, len, &spaces)) {
+			current_array->invalid_utf8 = true;
+		} else {
+			tokenize(addr, len, true,
+				 spaces ? split_view : emit_view,
+				 current_array);
 		}
 	}
-	if (bottom_flag && !top_flag) {
-		if (num_from_bottom > current_array->words_len) {
-			num_from_bottom = current_array->words_len;
+	return (true);
+}
+
+void load_words(struct words_array *current_array, char **input_files,
+		size_t count_files)
+// Iterates through each file passed to it, tokenizing individual
+// words on any whitespace character and appending a view of each
+// to current_array. Regular files are mapped and tokenized in
+// place, anything else is read as a stream. Files are opened one at
+// a time, and a mapping outlives its descriptor, so only one is ever
+// open.
+{
+	current_array->maps = calloc(count_files, sizeof(*current_array->maps));
+	if (!current_array->maps) {
+		// Case: Out of memory
+		free_words_array(current_array);
+		fprintf(stderr, "Memory allocation error.\n");
+		exit(MEMORY_ERROR);
+	}
+	for (size_t i = 0; i < count_files; ++i) {
+		load_path(current_array, input_files[i], options.threads);
+	}
+}
+
+void load_path(struct words_array *current_array, const char *name,
+	       size_t threads)
+// Opens the file name and loads it with load_file(). main() checked
+// that it could be opened, but it may have changed since.
+{
+	int fd = open(name, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "%s could not be opened", name);
+		perror(" \b");
+		free_words_array(current_array);
+		exit(FILE_ERROR);
+	}
+	load_file(current_array, name, fd, threads);
+}
+
+void load_file(struct words_array *current_array, const char *name, int fd,
+	       size_t threads)
+// Appends a view of each word of the file open on fd, named name, to
+// current_array, then closes fd. Regular files are mapped, using the
+// next free entry of current_array->maps. Anything else is read by
+// input_read(), and its words are copied into the arena.
+{
+	if (!load_mapped(current_array, fd, threads)
+	    && !input_read(fd, emit_copy, options.utf8 ? split_copy : NULL,
+			   current_array)) {
+		if (errno == ENOMEM) {
+			// Case: Out of memory
+			free_words_array(current_array);
+			fprintf(stderr, "Memory allocation error.\n");
+			exit(MEMORY_ERROR);
 		}
-		for (size_t i = 0;
-		     i < current_array->words_len - num_from_bottom; ++i) {
-			// Set everything outside of last i elements to NULL
-			free(current_array->words[i]);
-			current_array->words[i] = NULL;
+		if (errno != EILSEQ) {
+			fprintf(stderr, "%s could not be read", name);
+			perror(" \b");
+			free_words_array(current_array);
+			exit(FILE_ERROR);
 		}
+		// Case: Not UTF-8, reported below
+		current_array->invalid_utf8 = true;
 	}
+	if (current_array->invalid_utf8) {
+		fprintf(stderr, "%s is not valid UTF-8.\n", name);
+		free_words_array(current_array);
+		exit(FILE_ERROR);
+	}
+	close(fd);
 }
 
-void resize_array(struct words_array *current_array)
-// Allocates space for a new array of words, copies all
-// non-null words into it and then resizes it. Modifies
-// the passed argument in-place. This MUST be called after
-// any of the prune functions to remove the null pointers.
+void load_words_interactively(struct words_array *current_array)
+// This is functionally the same as load words, but accepting from
+// stdin instead of from a file. Standard input redirected from a
+// regular file is mapped like any other.
 {
-	char **tmp_words =
-	    calloc(current_array->words_len, sizeof(*current_array->words));
-	if (!tmp_words) {
+	current_array->maps = calloc(1, sizeof(*current_array->maps));
+	if (!current_array->maps) {
 		// Case: Out of memory
-		for (size_t i = 0; i < current_array->words_len; ++i) {
-			free(current_array->words[i]);
+		free_words_array(current_array);
+		fprintf(stderr, "Memory allocation error.\n");
+		exit(MEMORY_ERROR);
+	}
+	load_file(current_array, "Standard input", STDIN_FILENO,
+		  options.threads);
+}
+
+void spill_run(struct words_array *current_array)
+// Sorts the words held by current_array, writes them to its external
+// sort as the next run and empties current_array for more input.
+// Scrabble validation does not depend on order, so it is done here,
+// before anything reaches the disk.
+{
+	stats_add_words(current_array->words, current_array->words_len);
+	if (options.scrabble_validation) {
+		prune_words(current_array, true, false, options.algorithm,
+			    options.case_insens);
+	}
+	stats_begin(STATS_SORT);
+	if (!sort_words(current_array->words, current_array->words_len,
+			options.algorithm, options.threads)) {
+		free_words_array(current_array);
+		fprintf(stderr, "Memory allocation error.\n");
+		exit(MEMORY_ERROR);
+	}
+	stats_end(STATS_SORT);
+	if (!ext_write_run(current_array->ext, current_array->words,
+			   current_array->words_len)) {
+		perror("Temporary file could not be written");
+		free_words_array(current_array);
+		exit(FILE_ERROR);
+	}
+	current_array->words_len = 0;
+	arena_reset(current_array->arena);
+}
+
+bool is_stream_duplicate(struct stream_dedup *dedup, const struct word *word)
+// Returns true if word, the next word of a sorted stream, duplicates
+// an earlier one for the purposes of the -u option. Where duplicates
+// always compare equal under the sort algorithm, only the distinct
+// words of the current run of equal words need to be remembered;
+// otherwise every distinct word of the stream is. The first of each
+// set of duplicates is kept, as prune_words does.
+{
+	bool new_run = !dedup->first.str
+	    || (equates_duplicates(options.algorithm, options.case_insens)
+		&& options.algorithm(&dedup->first, word) != 0);
+	if (!new_run
+	    && groups_duplicates(options.algorithm, options.case_insens)) {
+		// Case: Everything after the first word of the run is a duplicate
+		return (true);
+	}
+	if (new_run) {
+		if (dedup->arena) {
+			arena_reset(dedup->arena);
 		}
-		free(current_array->words);
-		free(current_array);
+		word_set_clear(&dedup->seen);
+	}
+	bool added;
+	struct word *stored = word_set_insert(&dedup->seen, word, &added);
+	if (!stored) {
 		fprintf(stderr, "Memory allocation error.\n");
 		exit(MEMORY_ERROR);
 	}
-	size_t new_size = 0;
-	for (size_t cur_word = 0; cur_word < current_array->words_len;
-	     ++cur_word) {
-		if (current_array->words[cur_word]) {
-			char *tmp_cur_word =
-			    calloc((strlen(current_array->words[cur_word]) + 1),
-				   sizeof(*current_array->words[cur_word]));
-			if (!tmp_cur_word) {
-				// Case: Out of memory
-				for (size_t i = 0; i < current_array->words_len;
-				     ++i) {
-					free(current_array->words[i]);
-				}
-				free(tmp_words);
-				free(current_array->words);
-				free(current_array);
-				fprintf(stderr, "Memory allocation error.\n");
-				exit(MEMORY_ERROR);
-			}
-			strncpy(tmp_cur_word, current_array->words[cur_word],
-				strlen(current_array->words[cur_word]));
-			tmp_words[new_size] = tmp_cur_word;
-			++new_size;
-		} else {
-			free(current_array->words[cur_word]);
+	if (!added) {
+		return (true);
+	}
+	if (dedup->arena) {
+		// The stream reuses its buffer, so the set keeps a copy
+		stored->str = arena_store(dedup->arena, word->str, word->len);
+		if (!stored->str) {
+			fprintf(stderr, "Memory allocation error.\n");
+			exit(MEMORY_ERROR);
 		}
 	}
-	char **tmp = realloc(tmp_words, new_size * sizeof(*tmp_words));
-	if (!tmp) {
-		// Case: Out of memory
-		for (size_t i = 0; i < current_array->words_len; ++i) {
-			free(current_array->words[i]);
+	if (new_run) {
+		dedup->first = *stored;
+	}
+	return (false);
+}
+
+int ext_source_next(void *ext, struct word *word)
+// word_source callback reading the merged runs of an external sort.
+{
+	return (ext_next(ext, word));
+}
+
+int run_source_next(void *merge, struct word *word)
+// word_source callback reading a merge of sorted runs in memory.
+{
+	return (run_merge_next(merge, word));
+}
+
+static void *file_worker(void *pool_ptr)
+// Thread body taking tasks from the pool until none are left. Each file
+// is loaded into an array of its own, pruned by -S and, unless -m was
+// given, sorted.
+{
+	struct file_pool *pool = pool_ptr;
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		size_t i = pool->next;
+		if (i < pool->tasks_len) {
+			++pool->next;
+		}
+		pthread_mutex_unlock(&pool->lock);
+		if (i >= pool->tasks_len) {
+			return (NULL);
 		}
-		free(current_array->words);
-		free(tmp_words);
-		free(current_array);
+		struct file_task *task = &pool->tasks[i];
+		struct words_array *array = create_words_array();
+		array->maps = calloc(1, sizeof(*array->maps));
+		if (!array->maps) {
+			// Case: Out of memory
+			free_words_array(array);
+			fprintf(stderr, "Memory allocation error.\n");
+			exit(MEMORY_ERROR);
+		}
+		task->array = array;
+		load_path(array, task->name, pool->threads_per_task);
+		// The planned filters shrink the file before it is sorted;
+		// print_merged() drops duplicates across files.
+		// filter_words() rather than prune_words(), whose --stats
+		// hooks are not meant for several threads
+		struct stage_plan plan;
+		plan_stages(&plan, array);
+		if ((plan.prefilter_scrabble || plan.prefilter_unique)
+		    && !filter_words(array->words, &array->words_len,
+				     plan.prefilter_scrabble,
+				     plan.prefilter_unique, NULL,
+				     options.case_insens)) {
+			task->failed = true;
+			continue;
+		}
+		if (!options.merge_only) {
+			task->failed = !sort_words(array->words,
+						   array->words_len,
+						   options.algorithm,
+						   pool->threads_per_task);
+		}
+	}
+}
+
+int print_files(char **input_files, size_t count_files)
+// Loads each input file into an array of its own and, unless -m was
+// given, sorts it, on a pool of up to options.threads threads. The
+// sorted files are then merged with a loser tree straight into the
+// output stages. Ties go to the earlier file, so the output is that of
+// one sort over every file. Returns the exit code for main.
+{
+	struct file_pool pool;
+	pool.tasks = calloc(count_files, sizeof(*pool.tasks));
+	size_t workers = count_files < options.threads
+	    ? count_files : options.threads;
+	pthread_t *ids = calloc(workers, sizeof(*ids));
+	bool *started = calloc(workers, sizeof(*started));
+	struct word **runs = calloc(count_files, sizeof(*runs));
+	size_t *lens = calloc(count_files, sizeof(*lens));
+	if (!pool.tasks || !ids || !started || !runs || !lens) {
+		free(pool.tasks);
+		free(ids);
+		free(started);
+		free(runs);
+		free(lens);
 		fprintf(stderr, "Memory allocation error.\n");
-		exit(MEMORY_ERROR);
+		return (MEMORY_ERROR);
 	}
-	// Free old contents of current_array
-	for (size_t i = 0; i < current_array->words_len; ++i) {
-		free(current_array->words[i]);
+	for (size_t i = 0; i < count_files; ++i) {
+		pool.tasks[i].name = input_files[i];
 	}
-	free(current_array->words);
+	pool.tasks_len = count_files;
+	pool.next = 0;
+	pool.threads_per_task = options.threads / count_files;
+	if (!pool.threads_per_task) {
+		pool.threads_per_task = 1;
+	}
+	pthread_mutex_init(&pool.lock, NULL);
+	stats_begin(STATS_LOAD);
+	for (size_t i = 1; i < workers; ++i) {
+		// A thread that cannot be started leaves its share to the
+		// others
+		started[i] = !pthread_create(&ids[i], NULL, file_worker, &pool);
+	}
+	file_worker(&pool);
+	for (size_t i = 1; i < workers; ++i) {
+		if (started[i]) {
+			pthread_join(ids[i], NULL);
+		}
+	}
+	stats_end(STATS_LOAD);
+	pthread_mutex_destroy(&pool.lock);
+	free(ids);
+	free(started);
 
-	current_array->words_len = new_size;
-	current_array->words = tmp;
-	return;
+	bool failed = false;
+	for (size_t i = 0; i < count_files; ++i) {
+		runs[i] = pool.tasks[i].array->words;
+		lens[i] = pool.tasks[i].array->words_len;
+		failed = failed || pool.tasks[i].failed;
+		stats_add_words(runs[i], lens[i]);
+	}
+	struct run_merge merge;
+	int result = MEMORY_ERROR;
+	if (!failed && run_merge_init(&merge, runs, lens, count_files,
+				      options.algorithm)) {
+		struct word_source source = { run_source_next, &merge, true };
+		stats_begin(STATS_MERGE);
+		result = print_merged(&source);
+		stats_end(STATS_MERGE);
+		run_merge_free(&merge);
+	} else {
+		fprintf(stderr, "Memory allocation error.\n");
+	}
+	for (size_t i = 0; i < count_files; ++i) {
+		free_words_array(pool.tasks[i].array);
+	}
+	free(pool.tasks);
+	free(runs);
+	free(lens);
+	return (result);
 }
 
-void prune_duplicates(struct words_array *current_array, bool case_insensitive)
-// Prunes the duplicate words from the given array for the purposes of the -u
-// option. 
+int print_merged(struct word_source *source)
+// Passes the sorted words of source through the -u, -c/-C and -r
+// stages to standard output. When the words to print depend on how
+// many there are, or must be printed last to first, the survivors of
+// -u are first set aside: as views if the words of source stay valid,
+// else in a temporary file. Returns the exit code for main.
 {
-	for (size_t anchor_word = 0; anchor_word < current_array->words_len;
-	     ++anchor_word) {
-		for (size_t word = (anchor_word + 1);
-		     word < current_array->words_len; ++word) {
-			if (!(current_array->words[word]
-			      && current_array->words[anchor_word])) {
-				continue;
+	struct stream_dedup dedup;
+	dedup.arena = source->stable ? NULL : arena_create();
+	dedup.first.str = NULL;
+	word_set_init(&dedup.seen, options.case_insens);
+	bool buffered = options.reversed || options.bottom_flag;
+	FILE *kept = buffered && !source->stable ? ext_temp_file() : NULL;
+	struct words_array *kept_words = buffered && source->stable
+	    ? create_words_array() : NULL;
+	struct output *out = output_create(STDOUT_FILENO);
+	if ((!source->stable && !dedup.arena)
+	    || (buffered && !source->stable && !kept) || !out) {
+		if (kept) {
+			fclose(kept);
+		}
+		if (kept_words) {
+			free_words_array(kept_words);
+		}
+		output_destroy(out);
+		arena_destroy(dedup.arena);
+		fprintf(stderr, "Memory allocation error.\n");
+		return (MEMORY_ERROR);
+	}
+	bool success = true;
+	size_t count = 0;
+	struct word word;
+	int result = 0;
+	while (success && (result = source->next(source->ctx, &word)) > 0) {
+		if (options.unique && is_stream_duplicate(&dedup, &word)) {
+			continue;
+		}
+		if (kept_words) {
+			append_word(kept_words, word.str, word.len);
+		} else if (kept) {
+			success = fwrite(word.str, 1, word.len, kept) == word.len
+			    && putc('\n', kept) != EOF;
+		} else {
+			if (options.top_flag && count == options.top_count) {
+				break;
 			}
-			if (!case_insensitive) {
-				if (!
-				    (strncmp
-				     (current_array->words[anchor_word],
-				      current_array->words[word],
-				      strlen(current_array->words[anchor_word])
-				      + 1))) {
-					free(current_array->words[word]);
-					current_array->words[word] = NULL;
-					continue;
-				}
-			} else {
-				if (!
-				    (strncasecmp
-				     (current_array->words[anchor_word],
-				      current_array->words[word],
-				      strlen(current_array->words[anchor_word])
-				      + 1))) {
-					free(current_array->words[word]);
-					current_array->words[word] = NULL;
-					continue;
-				}
+			output_word(out, &word);
+		}
+		++count;
+	}
+	word_set_free(&dedup.seen);
+	arena_destroy(dedup.arena);
+	success = success && result >= 0;
+
+	if (success && kept_words) {
+		prune_num_words(kept_words, options.top_count,
+				options.bottom_count, options.top_to_bottom,
+				options.top_flag, options.bottom_flag);
+		output_words(out, kept_words->words, kept_words->words_len,
+			     options.reversed, false);
+	}
+	if (kept_words) {
+		free_words_array(kept_words);
+	}
+	if (success && kept) {
+		size_t start;
+		size_t end;
+		words_window(count, options.top_count, options.bottom_count,
+			     options.top_to_bottom, options.top_flag,
+			     options.bottom_flag, &start, &end);
+		success = fflush(kept) != EOF;
+		rewind(kept);
+		char *line_buf = NULL;
+		size_t buf_size = 0;
+		off_t start_offset = 0;
+		for (size_t i = 0; success && i < end; ++i) {
+			if (i == start) {
+				start_offset = ftello(kept);
+			}
+			ssize_t read = getline(&line_buf, &buf_size, kept);
+			success = read > 0;
+			if (success && i >= start && !options.reversed) {
+				output_bytes(out, line_buf, read);
 			}
 		}
+		free(line_buf);
+		if (success && options.reversed && start < end) {
+			success = ext_print_reversed(kept, start_offset,
+						     ftello(kept), out);
+		}
+	}
+	if (kept) {
+		fclose(kept);
+	}
+	if (!success) {
+		output_destroy(out);
+		perror("Temporary file could not be read");
+		return (FILE_ERROR);
 	}
+	if (!output_flush(out)) {
+		output_destroy(out);
+		perror("Output could not be written");
+		return (FILE_ERROR);
+	}
+	output_destroy(out);
+	return (SUCCESS);
 }
 
-void prune_scrabble_words(struct words_array *current_array)
-// Removes Scrabble-invalid words from the current_array argument
-// by freeing the allocated string and setting the pointer to NULL.
-// No return value, modifies the given struct words_array in-place.
+int write_index(struct words_array *current_array)
+// Writes the sorted words of current_array to the file named by
+// --build-index, replacing it, and frees current_array. A file that
+// could not be written in full is removed. Returns the exit code for
+// main.
 {
-	for (size_t word = 0; word < current_array->words_len; ++word) {
-		int num_tiles[26] = { 9, 2, 2, 4, 12, 2, 3, 2, 9, 1,
-			1, 4, 2, 6, 8, 2, 1, 6, 4, 6,
-			4, 2, 2, 1, 2, 1
-		};		// Number of Scrabble tiles per letter in the alphabet
-		int blank_tiles = 2;
-		for (size_t chr = 0; chr < strlen(current_array->words[word]);
-		     ++chr) {
-			// tmp is the lowercase version of chr in word
-			char tmp = tolower(current_array->words[word][chr]);
-			if (!isalpha(tmp)) {
-				// Case: word contains invalid characters
-				free(current_array->words[word]);
-				current_array->words[word] = NULL;
-				break;
+	stats_begin(STATS_OUTPUT);
+	int fd = open(options.build_index, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	bool written = fd >= 0
+	    && index_write(fd, current_array->words, current_array->words_len,
+			   options.algorithm, options.case_insens,
+			   index_sort(options.algorithm, options.case_insens,
+				      options.scrabble_validation,
+				      options.utf8));
+	int error = errno;
+	if (fd >= 0 && close(fd) < 0 && written) {
+		written = false;
+		error = errno;
+	}
+	stats_end(STATS_OUTPUT);
+	free_words_array(current_array);
+	if (written) {
+		return (SUCCESS);
+	}
+	if (fd >= 0) {
+		unlink(options.build_index);
+	}
+	if (error == ENOMEM) {
+		fprintf(stderr, "Memory allocation error.\n");
+		return (MEMORY_ERROR);
+	}
+	errno = error;
+	fprintf(stderr, "%s could not be written", options.build_index);
+	perror(" \b");
+	return (FILE_ERROR);
+}
+
+int print_index(const char *name)
+// Answers -c, -C, -r and -u from the index file name, which must have
+// been built with the same sort options, without loading or sorting
+// anything: the window is found from the counts in the header and only
+// the words in it are read. Returns the exit code for main.
+{
+	int fd = open(name, O_RDONLY);
+	struct word_index index;
+	if (fd < 0 || !index_open(&index, fd)) {
+		if (errno == EINVAL) {
+			fprintf(stderr, "%s is not a ws index.\n", name);
+		} else {
+			fprintf(stderr, "%s could not be read", name);
+			perror(" \b");
+		}
+		if (fd >= 0) {
+			close(fd);
+		}
+		return (FILE_ERROR);
+	}
+	close(fd);
+	if (index.sort != index_sort(options.algorithm, options.case_insens,
+				     options.scrabble_validation,
+				     options.utf8)) {
+		fprintf(stderr, "%s was built with different sort options.\n",
+			name);
+		index_close(&index);
+		return (INVOCATION_ERROR);
+	}
+	size_t len = options.unique ? index.unique : index.words;
+	size_t start;
+	size_t end;
+	words_window(len, options.top_count, options.bottom_count,
+		     options.top_to_bottom, options.top_flag,
+		     options.bottom_flag, &start, &end);
+
+	stats_begin(STATS_OUTPUT);
+	struct output *out = output_create(STDOUT_FILENO);
+	if (!out) {
+		index_close(&index);
+		fprintf(stderr, "Memory allocation error.\n");
+		return (MEMORY_ERROR);
+	}
+	bool valid = true;
+	for (size_t i = 0; valid && i < end - start; ++i) {
+		size_t pos = options.reversed ? end - 1 - i : start + i;
+		struct word word;
+		valid = index_word(&index, pos, options.unique, &word);
+		if (valid) {
+			output_word(out, &word);
+		}
+	}
+	bool flushed = output_flush(out);
+	stats_end(STATS_OUTPUT);
+	output_destroy(out);
+	index_close(&index);
+	if (!valid) {
+		fprintf(stderr, "%s is corrupt.\n", name);
+		return (FILE_ERROR);
+	}
+	if (!flushed) {
+		perror("Output could not be written");
+		return (FILE_ERROR);
+	}
+	return (SUCCESS);
+}
+
+bool parse_size(const char *str, size_t *size)
+// Parses a byte count for --memory-limit into size. The number may be
+// followed by K, M or G for units of 1024, 1024^2 or 1024^3 bytes.
+// Returns false if str is not a valid, nonzero size.
+{
+	char *err = '\0';
+	unsigned long long int num = strtoull(str, &err, 10);
+	if (err == str || *str == '-') {
+		return (false);
+	}
+	unsigned int shift = 0;
+	switch (toupper((unsigned char)*err)) {
+	case 'K':
+		shift = 10;
+		++err;
+		break;
+	case 'M':
+		shift = 20;
+		++err;
+		break;
+	case 'G':
+		shift = 30;
+		++err;
+		break;
+	}
+	if (*err || !num || num > (SIZE_MAX >> shift)) {
+		return (false);
+	}
+	*size = num << shift;
+	return (true);
+}
+
+void words_window(size_t len, size_t num_from_top, size_t num_from_bottom,
+		  bool top_to_bottom, bool top_flag, bool bottom_flag,
+		  size_t *start, size_t *end)
+// Works out which of len sorted words survive the given -c and -C
+// options, storing the index of the first survivor in start and one
+// past the last in end.
+{
+	if (num_from_top > len) {
+		num_from_top = len;
+	}
+	if (num_from_bottom > len) {
+		num_from_bottom = len;
+	}
+	*start = 0;
+	*end = len;
+	if (top_flag && bottom_flag) {
+		if (top_to_bottom) {
+			// Last num_from_bottom of the first num_from_top
+			if (num_from_bottom > num_from_top) {
+				num_from_bottom = num_from_top;
 			}
-			// alpha_index becomes the index from 0 - 25 in the
-			// alphabet for the purposes of indexing into num_tiles
-			int alpha_index = tmp - 'a';
-			if (num_tiles[alpha_index] > 0) {
-				--num_tiles[alpha_index];
-			} else if (blank_tiles > 0) {
-				--blank_tiles;
-			} else {
-				// Case: word exceeds valid tile allotment
-				free(current_array->words[word]);
-				current_array->words[word] = NULL;
-				break;
+			*start = num_from_top - num_from_bottom;
+			*end = num_from_top;
+		} else {
+			// First num_from_top of the last num_from_bottom
+			if (num_from_top > num_from_bottom) {
+				num_from_top = num_from_bottom;
 			}
+			*start = len - num_from_bottom;
+			*end = *start + num_from_top;
 		}
+	} else if (top_flag) {
+		*end = num_from_top;
+	} else if (bottom_flag) {
+		*start = len - num_from_bottom;
 	}
-	return;
-}
\ No newline at end of file
+}
+
+void prune_num_words(struct words_array *current_array, size_t num_from_top,
+		     size_t num_from_bottom, bool top_to_bottom, bool top_flag,
+		     bool bottom_flag)
+// Prunes the top or bottom n numbers from the file based on the given
+// -c and -C options by moving the surviving views to the front of the
+// array and shortening it.
+{
+	stats_begin(STATS_FILTER);
+	size_t start;
+	size_t end;
+	words_window(current_array->words_len, num_from_top, num_from_bottom,
+		     top_to_bottom, top_flag, bottom_flag, &start, &end);
+	memmove(current_array->words, current_array->words + start,
+		(end - start) * sizeof(*current_array->words));
+	current_array->words_len = end - start;
+	++stats.prune_passes;
+	stats_end(STATS_FILTER);
+}
+
+void prune_words(struct words_array *current_array, bool scrabble,
+		 bool unique, int (*algorithm)(const void *, const void *),
+		 bool case_insensitive)
+// Removes Scrabble-invalid words and, for -u, duplicate words from
+// current_array with filter_words(), exiting if out of memory.
+{
+	stats_begin(STATS_FILTER);
+	if (!filter_words(current_array->words, &current_array->words_len,
+			  scrabble, unique, algorithm, case_insensitive)) {
+		free_words_array(current_array);
+		fprintf(stderr, "Memory allocation error.\n");
+		exit(MEMORY_ERROR);
+	}
+	++stats.prune_passes;
+	stats_end(STATS_FILTER);
+}
+
+bool mostly_duplicates(const struct words_array *current_array)
+// Returns true if at most 1/PLAN_MAX_DISTINCT_FRACTION of
+// PLAN_SAMPLE_WORDS words spread evenly over current_array are
+// distinct for the purposes of the -u option. Returns false if the
+// sample cannot be hashed.
+{
+	size_t len = current_array->words_len;
+	size_t step = len > PLAN_SAMPLE_WORDS ? len / PLAN_SAMPLE_WORDS : 1;
+	struct word_set seen;
+	word_set_init(&seen, options.case_insens);
+	size_t sampled = 0;
+	for (size_t i = 0; i < len && sampled < PLAN_SAMPLE_WORDS;
+	     i += step) {
+		bool added;
+		if (!word_set_insert(&seen, &current_array->words[i], &added)) {
+			word_set_free(&seen);
+			return (false);
+		}
+		++sampled;
+	}
+	bool result = seen.len * PLAN_MAX_DISTINCT_FRACTION <= sampled;
+	word_set_free(&seen);
+	return (result);
+}
+
+void plan_stages(struct stage_plan *plan,
+		 const struct words_array *current_array)
+// Plans the stages main() runs on the words of current_array. Filters
+// that do not depend on order run first, fused into one pass, so that
+// only words that can be printed are sorted. Hashing keeps the first
+// of each set of duplicates in input order, which the stable sort also
+// puts first, so the output is the same as pruning after the sort;
+// where duplicates need not compare equal (equates_duplicates()), the
+// sort can put a later one first, and -u waits for the sort. When
+// sorting already puts duplicates next to each other, hashing
+// every word costs more than comparing neighbours afterwards unless
+// most words are duplicates, so a sample decides; input that -m
+// leaves unsorted is already ordered and is never hashed. Words
+// interned by --count are unique already.
+{
+	plan->order = !options.merge_only;
+	plan->prefilter_scrabble = options.scrabble_validation;
+	plan->prefilter_unique = options.unique && plan->order
+	    && !options.count
+	    && equates_duplicates(options.algorithm, options.case_insens)
+	    && (!groups_duplicates(options.algorithm, options.case_insens)
+		|| mostly_duplicates(current_array));
+	plan->unique = options.unique && !options.count
+	    && !plan->prefilter_unique;
+	plan->window = options.top_flag || options.bottom_flag;
+}